@@ -0,0 +1,192 @@
+/**
+ * @file asynclog.hpp
+ * @brief Low-overhead asynchronous logging via per-thread ring buffers.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/****************************************************************************/
+
+/**
+ * @brief An asynchronous line logger.
+ *
+ * Each thread that logs gets its own fixed-size single-producer,
+ * single-consumer ring of timestamped messages, so Log() normally takes no
+ * locks and does no I/O. A background flusher thread started by Start()
+ * periodically drains every ring, merges the messages in timestamp order and
+ * writes them to stdout in one go, each prefixed with its time in seconds
+ * since the logger was constructed.
+ *
+ * Messages therefore reach stdout up to one flush interval after they're
+ * logged, so they can appear after output written directly at the time.
+ *
+ * If a thread's ring is full, Log() flushes synchronously rather than drop
+ * the message; the number of times that happened is reported by Stop().
+ *
+ * Rings are registered on a thread's first message and dropped once the
+ * thread has exited and its ring has been drained. Messages logged before
+ * Start() are held until the first flush.
+ */
+class AsyncLog {
+   public:
+    using clock = std::chrono::steady_clock;
+
+    explicit AsyncLog(size_t ring_size = 256,
+                      std::chrono::milliseconds interval =
+                          std::chrono::milliseconds(10))
+        : ring_size_(ring_size), interval_(interval), start_(clock::now()) {}
+    ~AsyncLog() { Stop(); }
+
+    //! Start the flusher thread.
+    void Start() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!thread_.joinable()) {
+            stop_ = false;
+            thread_ = std::thread([this]() { Flusher(); });
+        }
+    }
+
+    //! Stop the flusher thread, writing out everything logged so far.
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        Flush();
+        if (auto stalls = stalls_.exchange(0)) {
+            fprintf(stderr, "log: %lu messages found their ring full\n",
+                    static_cast<unsigned long>(stalls));
+        }
+    }
+
+    //! Queue @p msg, timestamped now, on the calling thread's ring.
+    void Log(std::string msg) {
+        auto now = clock::now();
+        thread_local auto ring = Register();
+        auto tail = ring->tail.load(std::memory_order_relaxed);
+        if (tail - ring->head.load(std::memory_order_acquire) >= ring_size_) {
+            stalls_++;
+            Flush();
+        }
+        auto& entry = ring->entries[tail % ring_size_];
+        entry.time = now;
+        entry.msg = std::move(msg);
+        ring->tail.store(tail + 1, std::memory_order_release);
+        // Wake the flusher early if this ring is filling up.
+        if (tail - ring->head.load(std::memory_order_relaxed) ==
+            ring_size_ / 2) {
+            cv_.notify_one();
+        }
+    }
+
+    //! Drain every ring and write the messages out, on the calling thread.
+    void Flush() {
+        std::lock_guard<std::mutex> consume(consume_mutex_);
+        auto rings = std::vector<std::shared_ptr<Ring>>{};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            // The ring's owner holds the only other reference, so a unique
+            // ring's thread has exited. Take its last messages below and
+            // let it go.
+            auto live = std::vector<std::shared_ptr<Ring>>{};
+            for (auto& ring : rings_) {
+                if (ring.use_count() > 1) {
+                    live.push_back(ring);
+                }
+                rings.push_back(std::move(ring));
+            }
+            rings_ = std::move(live);
+        }
+        auto batch = std::vector<Entry>{};
+        for (auto& ring : rings) {
+            auto head = ring->head.load(std::memory_order_relaxed);
+            auto tail = ring->tail.load(std::memory_order_acquire);
+            for (; head != tail; head++) {
+                batch.push_back(std::move(ring->entries[head % ring_size_]));
+            }
+            ring->head.store(head, std::memory_order_release);
+        }
+        if (batch.empty()) {
+            return;
+        }
+        std::stable_sort(batch.begin(), batch.end(),
+                         [](const Entry& a, const Entry& b) {
+                             return a.time < b.time;
+                         });
+        auto out = std::string{};
+        for (const auto& entry : batch) {
+            char stamp[32];
+            snprintf(stamp, sizeof(stamp), "[%12.6f] ",
+                     std::chrono::duration<double>(entry.time - start_)
+                         .count());
+            out += stamp;
+            out += entry.msg;
+            out += '\n';
+        }
+        fwrite(out.data(), 1, out.size(), stdout);
+        fflush(stdout);
+    }
+
+   private:
+    struct Entry {
+        clock::time_point time;
+        std::string msg;
+    };
+
+    // The producer advances tail, the consumer head; both only increase.
+    struct Ring {
+        explicit Ring(size_t size) : entries(size) {}
+        std::vector<Entry> entries;
+        std::atomic<size_t> head{0};
+        std::atomic<size_t> tail{0};
+    };
+
+    std::shared_ptr<Ring> Register() {
+        auto ring = std::make_shared<Ring>(ring_size_);
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.push_back(ring);
+        return ring;
+    }
+
+    void Flusher() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_) {
+            cv_.wait_for(lock, interval_);
+            lock.unlock();
+            Flush();
+            lock.lock();
+        }
+    }
+
+    size_t ring_size_;
+    std::chrono::milliseconds interval_;
+    clock::time_point start_;
+    std::atomic<size_t> stalls_{0};
+
+    std::mutex mutex_;  // Guards rings_, stop_ and thread_.
+    std::mutex consume_mutex_;
+    std::condition_variable cv_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+    std::thread thread_;
+    bool stop_ = false;
+};  // class AsyncLog
@@ -0,0 +1,733 @@
+/**
+ * @file launcher.hpp
+ * @brief Child process launching and pidfd/epoll-based reaping.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+using launch_clock = std::chrono::steady_clock;
+
+/****************************************************************************/
+
+/**
+ * @brief The outcome of running a child process.
+ *
+ * `error` is non-zero (an errno value) if the process couldn't be started at
+ * all, or couldn't be watched and was killed, in which case the remaining
+ * fields other than `start` are meaningless. Otherwise exactly one of
+ * `exit_code` and `signal` is valid, depending on `exited`.
+ *
+ * `timed_out` is set if the process overran its timeout and its process
+ * group was sent SIGKILL. If it then still didn't exit within the kill grace
+ * period it is abandoned unreaped, and `wedged` is set.
+ *
+ * `err_output` holds whatever the process wrote to stderr, if capture was
+ * requested.
+ */
+struct ProcessResult {
+    pid_t pid = -1;
+    int error = 0;
+    bool exited = false;
+    int exit_code = -1;
+    int signal = 0;
+    bool timed_out = false;
+    bool wedged = false;
+    std::string err_output;
+    launch_clock::time_point start{};
+    launch_clock::time_point end{};
+
+    //! True if the process started, ran and exited with status zero.
+    bool Success() const { return error == 0 && exited && exit_code == 0; }
+    //! Wall-clock run time of the process.
+    launch_clock::duration Elapsed() const { return end - start; }
+};
+
+/**
+ * @brief Per-launch options.
+ *
+ * A zero `timeout` means no timeout. A `not_before` in the future delays the
+ * start of the process (only Launcher supports this). If `capture_stderr` is
+ * set, the child's stderr is collected into ProcessResult::err_output instead
+ * of being inherited. If `cancelled` is set and returns true when the process
+ * is due to start, it isn't started and the launch fails with ECANCELED.
+ */
+struct LaunchOptions {
+    bool capture_stderr = false;
+    launch_clock::duration timeout = launch_clock::duration::zero();
+    launch_clock::duration kill_grace = std::chrono::seconds(5);
+    launch_clock::time_point not_before{};
+    std::function<bool()> cancelled;
+};
+
+/**
+ * @brief Process-wide registry of running children.
+ *
+ * Both run_process() and Launcher register their children here while
+ * they're running, so that a watchdog can find long-running ones regardless
+ * of how they were started.
+ */
+class ChildRegistry {
+   public:
+    struct Entry {
+        pid_t pid;
+        std::string label;
+        launch_clock::time_point start;
+    };
+
+    static ChildRegistry &Get() {
+        static ChildRegistry registry;
+        return registry;
+    }
+
+    void Add(pid_t pid,
+             const std::vector<std::string> &argv,
+             launch_clock::time_point start) {
+        auto label = std::string{};
+        for (const auto &arg : argv) {
+            label += (label.empty() ? "" : " ") + arg;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        children_[pid] = Entry{pid, label, start};
+    }
+    void Remove(pid_t pid) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        children_.erase(pid);
+    }
+    //! Return a copy of the current entries.
+    std::vector<Entry> Snapshot() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto entries = std::vector<Entry>{};
+        for (const auto &[pid, entry] : children_) {
+            entries.push_back(entry);
+        }
+        return entries;
+    }
+
+   private:
+    ChildRegistry() = default;
+
+    std::mutex mutex_;
+    std::unordered_map<pid_t, Entry> children_;
+};  // class ChildRegistry
+
+namespace launcher_detail {
+
+inline int pidfd_open(pid_t pid) {
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+}
+
+inline int pidfd_send_signal(int pidfd, int sig) {
+    return static_cast<int>(
+        syscall(SYS_pidfd_send_signal, pidfd, sig, nullptr, 0));
+}
+
+/**
+ * SIGKILL the child behind @p pidfd and everything in its process group,
+ * e.g. the mount.nfs that /bin/mount forked, which is the one actually
+ * stuck. The group can't go away while the unreaped leader is in it.
+ */
+inline void kill_group(int pidfd, pid_t pid) {
+    pidfd_send_signal(pidfd, SIGKILL);
+    kill(-pid, SIGKILL);
+}
+
+/**
+ * @brief posix_spawn(3) @p argv, returning the new pid and a pidfd for it.
+ *
+ * Opening the pidfd after the spawn is race-free: the child can't be reaped
+ * (and its pid reused) until we wait for it.
+ *
+ * The child leads a new process group, so that kill_group() reaches any
+ * helpers it starts.
+ *
+ * If @p errfd is non-null, the child's stderr is connected to a pipe whose
+ * (non-blocking) read end is returned there.
+ *
+ * @return 0 on success, else an errno value.
+ */
+inline int spawn(const std::vector<std::string> &argv,
+                 pid_t *pid,
+                 int *pidfd,
+                 int *errfd = nullptr) {
+    auto cargv = std::vector<char *>{};
+    for (auto &arg : argv) {
+        cargv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    cargv.push_back(nullptr);
+
+    int pipefd[2] = {-1, -1};
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (errfd) {
+        if (pipe2(pipefd, O_CLOEXEC) < 0) {
+            posix_spawn_file_actions_destroy(&actions);
+            return errno;
+        }
+        // dup2() clears FD_CLOEXEC on the new descriptor.
+        posix_spawn_file_actions_adddup2(&actions, pipefd[1], STDERR_FILENO);
+    }
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attr, 0);
+
+    int err = posix_spawn(pid, cargv[0], &actions, &attr, cargv.data(),
+                          environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (errfd) {
+        close(pipefd[1]);
+        if (err != 0) {
+            close(pipefd[0]);
+        } else {
+            fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+            *errfd = pipefd[0];
+        }
+    }
+    if (err != 0) {
+        return err;
+    }
+    *pidfd = pidfd_open(*pid);
+    if (*pidfd < 0) {
+        err = errno;
+        waitpid(*pid, nullptr, 0);
+        if (errfd) {
+            close(*errfd);
+        }
+        return err;
+    }
+    return 0;
+}
+
+/**
+ * Append whatever can be read without blocking from @p fd to @p out.
+ *
+ * @return false at EOF or on error, true if the pipe is still open.
+ */
+inline bool drain(int fd, std::string *out) {
+    char buf[4096];
+    for (;;) {
+        auto n = read(fd, buf, sizeof(buf));
+        if (n > 0) {
+            out->append(buf, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        return n < 0 && errno == EAGAIN;
+    }
+}
+
+//! Collect the exit status of the (exited) child behind @p pidfd.
+inline void reap(int pidfd, ProcessResult *result) {
+    siginfo_t info{};
+    if (waitid(static_cast<idtype_t>(P_PIDFD), pidfd, &info, WEXITED) < 0) {
+        result->error = errno;
+        return;
+    }
+    if (info.si_code == CLD_EXITED) {
+        result->exited = true;
+        result->exit_code = info.si_status;
+    } else {
+        result->signal = info.si_status;
+    }
+}
+
+//! Wait until @p fd is readable or @p deadline passes. True if readable.
+inline bool wait_readable(int fd, launch_clock::time_point deadline) {
+    for (;;) {
+        auto remain = std::chrono::ceil<std::chrono::milliseconds>(
+            deadline - launch_clock::now());
+        auto pfd = pollfd{fd, POLLIN, 0};
+        int n = poll(&pfd, 1, std::max<int>(0, remain.count()));
+        if (n > 0) {
+            return true;
+        }
+        if (n == 0) {
+            return false;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+}  // namespace launcher_detail
+
+/**
+ * @brief Run @p argv to completion on the calling thread.
+ *
+ * This is the one-blocking-thread-per-child model. argv[0] must be a full
+ * path; no PATH search is done. `opts.not_before` is ignored.
+ */
+inline ProcessResult run_process(const std::vector<std::string> &argv,
+                                 const LaunchOptions &opts = {}) {
+    auto result = ProcessResult{};
+    int pidfd = -1, errfd = -1;
+    result.start = launch_clock::now();
+    if (opts.cancelled && opts.cancelled()) {
+        result.error = ECANCELED;
+        result.end = result.start;
+        return result;
+    }
+    result.error = launcher_detail::spawn(
+        argv, &result.pid, &pidfd, opts.capture_stderr ? &errfd : nullptr);
+    if (result.error != 0) {
+        result.end = launch_clock::now();
+        return result;
+    }
+    ChildRegistry::Get().Add(result.pid, argv, result.start);
+
+    auto deadline = launch_clock::time_point::max();
+    if (opts.timeout != launch_clock::duration::zero()) {
+        deadline = result.start + opts.timeout;
+    }
+    // Read stderr while waiting, so a chatty child can't fill the pipe and
+    // block.
+    for (;;) {
+        auto fds = std::vector<pollfd>{{pidfd, POLLIN, 0}};
+        if (errfd >= 0) {
+            fds.push_back({errfd, POLLIN, 0});
+        }
+        int ms = -1;
+        if (deadline != launch_clock::time_point::max()) {
+            ms = std::max<int>(
+                0, std::chrono::ceil<std::chrono::milliseconds>(
+                       deadline - launch_clock::now())
+                       .count());
+        }
+        int n = poll(fds.data(), fds.size(), ms);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (errfd >= 0 && fds.size() > 1 && fds[1].revents) {
+            if (!launcher_detail::drain(errfd, &result.err_output)) {
+                close(errfd);
+                errfd = -1;
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            break;
+        }
+        if (n == 0) {
+            result.timed_out = true;
+            launcher_detail::kill_group(pidfd, result.pid);
+            if (!launcher_detail::wait_readable(
+                    pidfd, launch_clock::now() + opts.kill_grace)) {
+                result.wedged = true;
+            }
+            break;
+        }
+    }
+    if (!result.wedged) {
+        launcher_detail::reap(pidfd, &result);
+    }
+    result.end = launch_clock::now();
+    if (errfd >= 0) {
+        launcher_detail::drain(errfd, &result.err_output);
+        close(errfd);
+    }
+    close(pidfd);
+    ChildRegistry::Get().Remove(result.pid);
+    return result;
+}
+
+/****************************************************************************/
+
+/**
+ * @brief Asynchronous process launcher.
+ *
+ * Children are started with posix_spawn(3) and a pidfd is opened for each.
+ * The pidfds are registered with an epoll instance, and a single reaper
+ * thread waits on it. A pidfd becomes readable when its process exits, so
+ * one thread can keep any number of children in flight, and the exit
+ * timestamp is taken as soon as epoll_wait(2) returns rather than whenever a
+ * blocked thread happens to be rescheduled.
+ *
+ * The reaper thread also enforces timeouts, sending SIGKILL through the
+ * pidfd and to the child's process group, starts delayed launches when they
+ * fall due, and collects captured stderr from pipes registered with the same
+ * epoll instance.
+ *
+ * Completion callbacks run on the reaper thread, so they should be brief.
+ * They may call Launch(). The destructor waits for all outstanding and
+ * delayed children to complete.
+ *
+ * Unexpected epoll_ctl(2) failures that don't affect a launch's result are
+ * passed to @p warn, if given.
+ */
+class Launcher {
+   public:
+    using callback = std::function<void(const ProcessResult &)>;
+    using warn_function = std::function<void(const std::string &)>;
+
+    explicit Launcher(warn_function warn = {}) : warn_(std::move(warn)) {
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd_ < 0) {
+            throw std::runtime_error(
+                std::string("epoll_create1 failed: ") + strerror(errno));
+        }
+        wakefd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (wakefd_ < 0) {
+            close(epfd_);
+            throw std::runtime_error(std::string("eventfd failed: ") +
+                                     strerror(errno));
+        }
+        if (int err = Watch(wakefd_, false)) {
+            close(wakefd_);
+            close(epfd_);
+            throw std::runtime_error(std::string("epoll_ctl failed: ") +
+                                     strerror(err));
+        }
+        reaper_ = std::thread([this]() { Reap(); });
+    }
+    ~Launcher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        Wake();
+        reaper_.join();
+        close(wakefd_);
+        close(epfd_);
+    }
+    Launcher(const Launcher &) = delete;
+    Launcher &operator=(const Launcher &) = delete;
+
+    /**
+     * @brief Start @p argv, calling @p done on the reaper thread when it
+     * exits.
+     *
+     * If the process can't be started, @p done is called with
+     * ProcessResult::error set, on whichever thread tried to start it.
+     */
+    void Launch(const std::vector<std::string> &argv,
+                const LaunchOptions &opts,
+                callback done) {
+        if (opts.not_before > launch_clock::now()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_.emplace(opts.not_before,
+                                 Pending{argv, opts, std::move(done)});
+            }
+            Wake();
+            return;
+        }
+        Start(argv, opts, std::move(done));
+    }
+    void Launch(const std::vector<std::string> &argv, callback done) {
+        Launch(argv, LaunchOptions{}, std::move(done));
+    }
+
+    //! Start @p argv, returning a future for its result.
+    std::future<ProcessResult> Launch(const std::vector<std::string> &argv,
+                                      const LaunchOptions &opts = {}) {
+        auto promise = std::make_shared<std::promise<ProcessResult>>();
+        auto future = promise->get_future();
+        Launch(argv, opts, [promise](const ProcessResult &result) {
+            promise->set_value(result);
+        });
+        return future;
+    }
+
+    //! The number of children started but not yet reaped.
+    size_t InFlight() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return inflight_.size();
+    }
+
+   private:
+    using deadline_map = std::multimap<launch_clock::time_point, int>;
+
+    struct Child {
+        ProcessResult result;
+        LaunchOptions opts;
+        callback done;
+        deadline_map::iterator deadline;
+        bool has_deadline = false;
+        int errfd = -1;
+    };
+    struct Pending {
+        std::vector<std::string> argv;
+        LaunchOptions opts;
+        callback done;
+    };
+
+    // epoll_event data is the fd, with this bit set for stderr pipes.
+    static constexpr uint64_t pipe_flag = 1ULL << 32;
+
+    //! @return 0 on success, else an errno value.
+    int Watch(int fd, bool is_pipe) {
+        auto ev = epoll_event{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = static_cast<uint32_t>(fd) | (is_pipe ? pipe_flag : 0);
+        return epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0 ? errno : 0;
+    }
+
+    void Unwatch(int fd) {
+        if (epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr) < 0 && warn_) {
+            warn_(std::string("epoll_ctl(EPOLL_CTL_DEL) failed for fd ") +
+                  std::to_string(fd) + ": " + strerror(errno));
+        }
+    }
+
+    void Wake() {
+        uint64_t one = 1;
+        [[maybe_unused]] auto n = write(wakefd_, &one, sizeof(one));
+    }
+
+    void Start(const std::vector<std::string> &argv,
+               const LaunchOptions &opts,
+               callback done) {
+        auto result = ProcessResult{};
+        int pidfd = -1, errfd = -1;
+        result.start = launch_clock::now();
+        if (opts.cancelled && opts.cancelled()) {
+            result.error = ECANCELED;
+            result.end = result.start;
+            done(result);
+            return;
+        }
+        result.error = launcher_detail::spawn(
+            argv, &result.pid, &pidfd, opts.capture_stderr ? &errfd : nullptr);
+        if (result.error != 0) {
+            result.end = launch_clock::now();
+            done(result);
+            return;
+        }
+        ChildRegistry::Get().Add(result.pid, argv, result.start);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto &child = inflight_[pidfd];
+            child = Child{result, opts, std::move(done), deadlines_.end()};
+            if (opts.timeout != launch_clock::duration::zero()) {
+                child.deadline =
+                    deadlines_.emplace(result.start + opts.timeout, pidfd);
+                child.has_deadline = true;
+            }
+            if (errfd >= 0) {
+                child.errfd = errfd;
+                pipes_[errfd] = pidfd;
+            }
+        }
+        int err = Watch(pidfd, false);
+        if (err == 0 && errfd >= 0) {
+            err = Watch(errfd, true);
+            if (err != 0) {
+                Unwatch(pidfd);
+            }
+        }
+        if (err != 0) {
+            // The reaper would never see it exit. Kill it and fail the
+            // launch here instead.
+            auto child = Child{};
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (errfd >= 0) {
+                    pipes_.erase(errfd);
+                    inflight_[pidfd].errfd = -1;
+                }
+                child = Detach(pidfd);
+            }
+            if (errfd >= 0) {
+                close(errfd);
+            }
+            launcher_detail::pidfd_send_signal(pidfd, SIGKILL);
+            launcher_detail::reap(pidfd, &child.result);
+            close(pidfd);
+            ChildRegistry::Get().Remove(child.result.pid);
+            child.result.error = err;
+            child.result.end = launch_clock::now();
+            child.done(child.result);
+            return;
+        }
+        // The reaper may need to shorten its epoll_wait() for the deadline.
+        if (opts.timeout != launch_clock::duration::zero()) {
+            Wake();
+        }
+    }
+
+    //! Remove @p fd's child from the tables. Call with mutex_ held.
+    Child Detach(int fd) {
+        auto it = inflight_.find(fd);
+        auto child = std::move(it->second);
+        inflight_.erase(it);
+        if (child.has_deadline) {
+            deadlines_.erase(child.deadline);
+        }
+        if (child.errfd >= 0) {
+            launcher_detail::drain(child.errfd, &child.result.err_output);
+            CloseErr(child.errfd);
+            child.errfd = -1;
+        }
+        return child;
+    }
+
+    //! Stop watching and close a stderr pipe. Call with mutex_ held.
+    void CloseErr(int errfd) {
+        Unwatch(errfd);
+        pipes_.erase(errfd);
+        close(errfd);
+    }
+
+    //! Read a readable stderr pipe into its child's result.
+    void ReadErr(int errfd) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto pit = pipes_.find(errfd);
+        if (pit == pipes_.end()) {
+            return;
+        }
+        auto &child = inflight_[pit->second];
+        if (!launcher_detail::drain(errfd, &child.result.err_output)) {
+            CloseErr(errfd);
+            child.errfd = -1;
+        }
+    }
+
+    //! Milliseconds until the next timer falls due, or -1 for none.
+    int NextTimeout() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto next = launch_clock::time_point::max();
+        if (!deadlines_.empty()) {
+            next = deadlines_.begin()->first;
+        }
+        if (!pending_.empty()) {
+            next = std::min(next, pending_.begin()->first);
+        }
+        if (next == launch_clock::time_point::max()) {
+            return -1;
+        }
+        auto ms = std::chrono::ceil<std::chrono::milliseconds>(
+            next - launch_clock::now());
+        return std::max<int>(0, ms.count());
+    }
+
+    //! Start due delayed launches, and kill or abandon overdue children.
+    void RunTimers(launch_clock::time_point now) {
+        auto due = std::vector<Pending>{};
+        auto abandoned = std::vector<Child>{};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (!pending_.empty() && pending_.begin()->first <= now) {
+                due.push_back(std::move(pending_.begin()->second));
+                pending_.erase(pending_.begin());
+            }
+            while (!deadlines_.empty() && deadlines_.begin()->first <= now) {
+                int fd = deadlines_.begin()->second;
+                auto &child = inflight_[fd];
+                if (!child.result.timed_out) {
+                    // First expiry: kill it and allow a grace period.
+                    child.result.timed_out = true;
+                    launcher_detail::kill_group(fd, child.result.pid);
+                    deadlines_.erase(child.deadline);
+                    child.deadline =
+                        deadlines_.emplace(now + child.opts.kill_grace, fd);
+                    continue;
+                }
+                // Second expiry: it didn't die. Give up on it.
+                Unwatch(fd);
+                auto gone = Detach(fd);
+                close(fd);
+                gone.result.wedged = true;
+                gone.result.end = now;
+                abandoned.push_back(std::move(gone));
+            }
+        }
+        for (auto &child : abandoned) {
+            ChildRegistry::Get().Remove(child.result.pid);
+            child.done(child.result);
+        }
+        for (auto &p : due) {
+            Start(p.argv, p.opts, std::move(p.done));
+        }
+    }
+
+    void Reap() {
+        constexpr int max_events = 256;
+        epoll_event events[max_events];
+        for (;;) {
+            int n = epoll_wait(epfd_, events, max_events, NextTimeout());
+            auto now = launch_clock::now();
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(
+                    std::string("epoll_wait failed: ") + strerror(errno));
+            }
+            for (int e = 0; e < n; e++) {
+                int fd = static_cast<int>(events[e].data.u64 & 0xffffffff);
+                if (events[e].data.u64 & pipe_flag) {
+                    ReadErr(fd);
+                    continue;
+                }
+                if (fd == wakefd_) {
+                    uint64_t count;
+                    [[maybe_unused]] auto r =
+                        read(wakefd_, &count, sizeof(count));
+                    continue;
+                }
+                Unwatch(fd);
+                auto child = Child{};
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    child = Detach(fd);
+                }
+                launcher_detail::reap(fd, &child.result);
+                child.result.end = now;
+                close(fd);
+                ChildRegistry::Get().Remove(child.result.pid);
+                child.done(child.result);
+            }
+            RunTimers(launch_clock::now());
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_ && inflight_.empty() && pending_.empty()) {
+                return;
+            }
+        }
+    }
+
+    warn_function warn_;
+    int epfd_ = -1;
+    int wakefd_ = -1;
+    std::thread reaper_;
+    std::mutex mutex_;
+    std::unordered_map<int, Child> inflight_;
+    std::unordered_map<int, int> pipes_;  // stderr pipe fd -> pidfd
+    deadline_map deadlines_;
+    std::multimap<launch_clock::time_point, Pending> pending_;
+    bool stopping_ = false;
+};  // class Launcher
@@ -1,15 +1,33 @@
 
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
 #include <exception>
 #include <filesystem>
 #include <functional>
 #include <future>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <numeric>
 #include <optional>
+#include <random>
+#include <set>
+#include <sstream>
 #include <vector>
 
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <sched.h>
 #include <stdlib.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
 #include <sys/signal.h>
+#include <sys/wait.h>
 
 #include <fmt/format.h>
 #include <boost/algorithm/string.hpp>
@@ -18,6 +36,8 @@
 #include <boost/thread/barrier.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 
+#include "asynclog.hpp"
+#include "launcher.hpp"
 #include "tempdir.hpp"
 
 namespace bp = boost::process;
@@ -25,54 +45,2857 @@ namespace fs = std::filesystem;
 namespace po = boost::program_options;
 
 using Context = struct {
+    std::vector<int> background_mounts;
+    std::string background_type;
+    int backoff_ms;
+    int backoff_max_ms;
+    std::string cgroup;
+    std::string cgroup_parent;
+    int churn_threads;
+    double cpu_quota;
+    std::string export_churn;
+    std::string export_mode;
+    std::vector<int> export_sweep;
+    std::string export_update;
+    std::string export_variant;
+    std::string fixture;
+    std::string fixture_dir;
+    double hang_threshold;
+    std::string io_max;
+    bool kmem;
+    std::string launcher;
+    std::string layout;
+    std::string memory_max;
+    bool mountstats;
+    std::vector<int> nfsd_threads_sweep;
+    int peers;
+    bool perf;
+    bool pipeline;
+    int pipeline_depth;
     bool preserve_temp;
+    bool private_ns;
+    bool propagation_sweep;
+    int retries;
+    bool rpc_stats;
+    bool rpc_trace;
+    double sample_interval;
+    int setup_threads;
+    int shard_size;
     int threads;
+    double timeout;
+    std::string trace;
     bool verbose;
 };
 
-static void verbose(const Context& ctx, const std::string& msg) {
-    if (ctx.verbose) {
-        std::cout << fmt::format("{}\n", msg);
+// Verbose output is logged asynchronously, so that mounter threads don't
+// serialize on the stream lock. Messages aren't even formatted unless
+// they're wanted.
+static AsyncLog verbose_log;
+
+#define VERBOSE(ctx, msg, ...)                                  \
+    do {                                                        \
+        if ((ctx).verbose) {                                    \
+            verbose_log.Log(                                    \
+                fmt::format(FMT_STRING(msg), ##__VA_ARGS__));   \
+        }                                                       \
+    } while (0)
+
+using clean_function = std::function<void()>;
+
+static std::optional<clean_function> cleanup;
+
+//! The thread running cleanup, or 0 until one starts it.
+static std::atomic<pid_t> cleanup_owner{0};
+static std::atomic<bool> cleanup_done{false};
+
+/**
+ * Run the cleanup function, if there is one, at most once. Any other thread
+ * that gets here meanwhile waits for it to finish, so that it can't exit from
+ * under it; a re-entrant call from the cleaning thread itself returns.
+ */
+static void run_cleanup() {
+    auto self = gettid();
+    auto owner = pid_t{0};
+    if (!cleanup_owner.compare_exchange_strong(owner, self)) {
+        while (owner != self && !cleanup_done) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return;
+    }
+    if (cleanup) {
+        auto fn = std::move(*cleanup);
+        cleanup.reset();
+        fn();
+    }
+    cleanup_done = true;
+}
+
+//! True once cleanup has started, after which nothing new should be launched.
+static bool cleaning_up() {
+    return cleanup_owner != 0;
+}
+
+[[noreturn]] [[maybe_unused]] static void error(const std::string& msg) {
+    verbose_log.Flush();
+    std::cerr << fmt::format("{}\n", msg);
+    run_cleanup();
+    exit(1);
+}
+[[noreturn]] static void error_sys(int syserr, const std::string& msg) {
+    verbose_log.Flush();
+    std::cerr << fmt::format("{}: {}\n", msg, strerror(syserr));
+    run_cleanup();
+    exit(1);
+}
+
+#define EFMT(msg, ...) error(fmt::format(FMT_STRING(msg), ##__VA_ARGS__))
+#define EFMT_SYS(err, msg, ...) \
+    error_sys(err, fmt::format(FMT_STRING(msg), ##__VA_ARGS__))
+
+static void sig_handler(int sig,
+                        siginfo_t* info,
+                        [[maybe_unused]] void* uctx) {
+    run_cleanup();
+}
+
+/**
+ * Collects timed spans and writes them out as a Chrome trace-event JSON
+ * file, for viewing as a timeline in Perfetto or chrome://tracing.
+ *
+ * Spans go on one of two trace processes: pid_threads, with a track for
+ * each of our threads, and pid_mounts, with a track for each mount in a
+ * wave. Tracks are numbered by thread id and mount index respectively.
+ */
+class Tracer {
+   public:
+    static constexpr int pid_threads = 1;
+    static constexpr int pid_mounts = 2;
+
+    Tracer(fs::path path)
+        : path_(std::move(path)), start_(launch_clock::now()) {}
+
+    /**
+     * Record span @p name in category @p cat. @p args, if given, is a JSON
+     * object of extra detail.
+     */
+    void Span(const std::string& name,
+              const std::string& cat,
+              int pid,
+              long tid,
+              launch_clock::time_point start,
+              launch_clock::time_point end,
+              const std::string& args = "") {
+        auto us = [this](launch_clock::time_point t) {
+            return std::chrono::duration<double, std::micro>(t - start_)
+                .count();
+        };
+        auto event = fmt::format(
+            FMT_STRING("{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\","
+                       "\"pid\":{},\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}"),
+            Escape(name), cat, pid, tid, us(start), us(end) - us(start));
+        if (!args.empty()) {
+            event += ",\"args\":" + args;
+        }
+        event += "}";
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.push_back(std::move(event));
+    }
+
+    //! Write the trace file. Failure is only reported, as this runs last.
+    void Write() {
+        auto tf = std::ofstream(path_, std::ios_base::trunc);
+        tf << "{\"traceEvents\":[\n";
+        tf << fmt::format(
+            FMT_STRING("{{\"name\":\"process_name\",\"ph\":\"M\","
+                       "\"pid\":{},\"args\":{{\"name\":\"threads\"}}}},\n"
+                       "{{\"name\":\"process_name\",\"ph\":\"M\","
+                       "\"pid\":{},\"args\":{{\"name\":\"mounts\"}}}}"),
+            pid_threads, pid_mounts);
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& event : events_) {
+            tf << ",\n" << event;
+        }
+        tf << "\n]}\n";
+        if (!tf) {
+            std::cerr << fmt::format(FMT_STRING("Failed to write trace {}\n"),
+                                     path_.native());
+        }
+    }
+
+    static std::string Escape(const std::string& s) {
+        auto out = std::string{};
+        for (auto c : s) {
+            if (static_cast<unsigned char>(c) < 0x20) {
+                out += fmt::format(FMT_STRING("\\u{:04x}"),
+                                   static_cast<int>(c));
+                continue;
+            }
+            if (c == '"' || c == '\\') {
+                out += '\\';
+            }
+            out += c;
+        }
+        return out;
+    }
+
+   private:
+    fs::path path_;
+    launch_clock::time_point start_;
+    std::mutex mutex_;
+    std::vector<std::string> events_;
+};  // class Tracer
+
+//! The trace being recorded, if any.
+static std::unique_ptr<Tracer> tracer;
+
+/**
+ * A span on the calling thread's track, from construction to destruction.
+ * Does nothing unless a trace is being recorded.
+ */
+class TraceSpan {
+   public:
+    TraceSpan(std::string name, std::string cat, std::string args = "")
+        : name_(std::move(name)),
+          cat_(std::move(cat)),
+          args_(std::move(args)),
+          start_(launch_clock::now()) {}
+    ~TraceSpan() {
+        if (tracer) {
+            tracer->Span(name_, cat_, Tracer::pid_threads, gettid(), start_,
+                         launch_clock::now(), args_);
+        }
+    }
+
+   private:
+    std::string name_;
+    std::string cat_;
+    std::string args_;
+    launch_clock::time_point start_;
+};  // class TraceSpan
+
+/**
+ * Print a one-line latency summary for a set of operations, e.g. one mount
+ * wave. Percentiles are nearest-rank.
+ */
+static void report_latency(const std::string& what,
+                           const std::vector<launch_clock::duration>& elapsed,
+                           launch_clock::duration wall) {
+    if (elapsed.empty()) {
+        return;
+    }
+    auto ms = std::vector<double>{};
+    for (const auto& e : elapsed) {
+        ms.push_back(std::chrono::duration<double, std::milli>(e).count());
+    }
+    std::sort(ms.begin(), ms.end());
+    auto pct = [&ms](double p) {
+        auto rank = static_cast<size_t>(p / 100.0 * (ms.size() - 1) + 0.5);
+        return ms[rank];
+    };
+    auto mean = std::accumulate(ms.begin(), ms.end(), 0.0) / ms.size();
+    std::cout << fmt::format(
+        FMT_STRING("{} latency (ms): n={} min={:.2f} mean={:.2f} p50={:.2f} "
+                   "p90={:.2f} p99={:.2f} max={:.2f} wall={:.2f}\n"),
+        what, ms.size(), ms.front(), mean, pct(50), pct(90), pct(99),
+        ms.back(), std::chrono::duration<double, std::milli>(wall).count());
+}
+
+/**
+ * The result of a mount, possibly after several attempts. `result` is the
+ * final attempt; `start` is when the first attempt began, so Elapsed()
+ * covers any retries and backoff.
+ */
+struct MountOutcome {
+    ProcessResult result;
+    int attempts = 0;
+    launch_clock::time_point start{};
+
+    launch_clock::duration Elapsed() const { return result.end - start; }
+};
+
+static LaunchOptions launch_options(const Context& ctx) {
+    auto opts = LaunchOptions{};
+    opts.capture_stderr = true;
+    opts.timeout = std::chrono::duration_cast<launch_clock::duration>(
+        std::chrono::duration<double>(ctx.timeout));
+    // A retry due after cleanup has started mustn't mount anything.
+    opts.cancelled = cleaning_up;
+    return opts;
+}
+
+//! Pass a launcher's warnings on to the verbose log.
+static Launcher::warn_function launcher_warn(const Context& ctx) {
+    return [&ctx](const std::string& msg) {
+        VERBOSE(ctx, "launcher: {}", msg);
+    };
+}
+
+/**
+ * Broad classes of mount failure. The mix of these under load says more
+ * about what's saturating than the raw failure count does.
+ */
+enum class FailureClass { timeout, busy, access, protocol, nomem, other };
+
+static constexpr FailureClass failure_classes[] = {
+    FailureClass::timeout, FailureClass::busy,  FailureClass::access,
+    FailureClass::protocol, FailureClass::nomem, FailureClass::other};
+
+static const char* failure_class_name(FailureClass fc) {
+    switch (fc) {
+        case FailureClass::timeout:
+            return "timeout";
+        case FailureClass::busy:
+            return "busy";
+        case FailureClass::access:
+            return "access";
+        case FailureClass::protocol:
+            return "protocol";
+        case FailureClass::nomem:
+            return "nomem";
+        case FailureClass::other:
+            return "other";
+    }
+    return "other";
+}
+
+/**
+ * Classify a failed mount helper from its errno (if it couldn't be started),
+ * whether it was killed for overrunning, and the messages mount.nfs wrote to
+ * stderr.
+ */
+static FailureClass classify_failure(const ProcessResult& result) {
+    if (result.error == ENOMEM || result.error == EAGAIN) {
+        return FailureClass::nomem;
+    }
+    if (result.timed_out) {
+        return FailureClass::timeout;
+    }
+    auto msg = boost::to_lower_copy(result.err_output);
+    auto has = [&msg](const char* s) {
+        return msg.find(s) != std::string::npos;
+    };
+    if (has("timed out") || has("timeout")) {
+        return FailureClass::timeout;
+    }
+    if (has("busy")) {
+        return FailureClass::busy;
+    }
+    if (has("access denied") || has("permission denied") ||
+        has("operation not permitted")) {
+        return FailureClass::access;
+    }
+    if (has("cannot allocate memory") || has("out of memory")) {
+        return FailureClass::nomem;
+    }
+    if (has("protocol") || has("not supported") || has("program not") ||
+        has("connection refused") || has("rpc")) {
+        return FailureClass::protocol;
+    }
+    return FailureClass::other;
+}
+
+/**
+ * Exponential backoff with jitter before retry number @p retry (1-based).
+ * The delay is uniformly distributed between half and all of the capped
+ * exponential value, which spreads out mounts that failed together.
+ */
+static launch_clock::duration backoff_delay(const Context& ctx, int retry) {
+    thread_local auto rng = std::mt19937{std::random_device{}()};
+    auto cap = std::min<double>(ctx.backoff_max_ms,
+                                ctx.backoff_ms * std::pow(2.0, retry - 1));
+    auto jitter = std::uniform_real_distribution<double>(cap / 2, cap);
+    return std::chrono::duration_cast<launch_clock::duration>(
+        std::chrono::duration<double, std::milli>(jitter(rng)));
+}
+
+/**
+ * Run @p argv on the calling thread, retrying failures up to ctx.retries
+ * times, or until cleanup starts.
+ */
+static MountOutcome run_with_retry(const Context& ctx,
+                                   const std::vector<std::string>& argv) {
+    auto outcome = MountOutcome{};
+    outcome.start = launch_clock::now();
+    for (;;) {
+        outcome.result = run_process(argv, launch_options(ctx));
+        outcome.attempts++;
+        if (outcome.result.Success() || outcome.attempts > ctx.retries ||
+            cleaning_up()) {
+            return outcome;
+        }
+        auto delay = backoff_delay(ctx, outcome.attempts);
+        VERBOSE(ctx, "retry '{}' in {}ms", argv.back(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(delay)
+                    .count());
+        std::this_thread::sleep_for(delay);
+    }
+}
+
+/**
+ * Launch @p argv on @p launcher, retrying failures up to ctx.retries times,
+ * or until cleanup starts. Retries are scheduled on the launcher after the
+ * backoff delay, so no thread sleeps.
+ */
+static std::future<MountOutcome> launch_with_retry(
+    const Context& ctx,
+    Launcher& launcher,
+    const std::vector<std::string>& argv) {
+    struct State {
+        std::promise<MountOutcome> promise;
+        MountOutcome outcome;
+        std::function<void(const ProcessResult&)> done;
+    };
+    auto state = std::make_shared<State>();
+    state->outcome.start = launch_clock::now();
+    // The callback holds a weak reference to the state, or the state would
+    // own itself forever.
+    state->done = [&ctx, &launcher, argv,
+                   weak = std::weak_ptr<State>(state)](
+                      const ProcessResult& result) {
+        auto state = weak.lock();
+        state->outcome.result = result;
+        state->outcome.attempts++;
+        if (result.Success() || state->outcome.attempts > ctx.retries ||
+            cleaning_up()) {
+            state->promise.set_value(state->outcome);
+            return;
+        }
+        auto opts = launch_options(ctx);
+        opts.not_before = launch_clock::now() +
+                          backoff_delay(ctx, state->outcome.attempts);
+        launcher.Launch(argv, opts,
+                        [state](const ProcessResult& r) { state->done(r); });
+    };
+    auto future = state->promise.get_future();
+    launcher.Launch(argv, launch_options(ctx),
+                    [state](const ProcessResult& r) { state->done(r); });
+    return future;
+}
+
+/**
+ * Return the contents of a (small) file, or "" if it can't be read. For
+ * /proc files.
+ */
+static std::string read_file(const fs::path& path) {
+    auto f = std::ifstream(path);
+    return std::string(std::istreambuf_iterator<char>(f),
+                       std::istreambuf_iterator<char>());
+}
+
+/**
+ * Describe process @p pid and its descendants: command line, wchan and
+ * kernel stack. Mount helpers fork, so the process actually stuck in the
+ * kernel is usually a grandchild (mount.nfs).
+ */
+static std::string describe_process(pid_t pid, int depth = 0) {
+    auto proc = fs::path("/proc") / std::to_string(pid);
+    auto cmdline = read_file(proc / "cmdline");
+    std::replace(cmdline.begin(), cmdline.end(), '\0', ' ');
+    auto indent = std::string(depth * 2, ' ');
+    auto desc = fmt::format(FMT_STRING("{}pid {} '{}' wchan {}\n"), indent,
+                            pid, boost::trim_copy(cmdline),
+                            read_file(proc / "wchan"));
+    auto stack = std::istringstream(read_file(proc / "stack"));
+    for (std::string line; std::getline(stack, line);) {
+        desc += indent + "  " + line + "\n";
+    }
+    auto children = std::istringstream(
+        read_file(proc / "task" / std::to_string(pid) / "children"));
+    for (pid_t child; children >> child;) {
+        desc += describe_process(child, depth + 1);
+    }
+    return desc;
+}
+
+/**
+ * Periodically check for child processes that have been running longer than
+ * a threshold, and report each one (once) on stderr with its kernel state.
+ */
+class HangWatchdog {
+   public:
+    HangWatchdog(double threshold) {
+        if (threshold <= 0) {
+            return;
+        }
+        threshold_ = std::chrono::duration_cast<launch_clock::duration>(
+            std::chrono::duration<double>(threshold));
+        thread_ = std::thread([this]() { Watch(); });
+    }
+    ~HangWatchdog() {
+        if (!thread_.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+   private:
+    void Watch() {
+        auto interval = std::min<launch_clock::duration>(
+            threshold_ / 2, std::chrono::seconds(1));
+        auto reported = std::set<pid_t>{};
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!cv_.wait_for(lock, interval, [this]() { return stop_; })) {
+            auto now = launch_clock::now();
+            for (const auto& child : ChildRegistry::Get().Snapshot()) {
+                if (now - child.start < threshold_ ||
+                    reported.count(child.pid)) {
+                    continue;
+                }
+                reported.insert(child.pid);
+                std::cerr << fmt::format(
+                    FMT_STRING("HANG: '{}' running for {:.1f}s\n{}"),
+                    child.label,
+                    std::chrono::duration<double>(now - child.start).count(),
+                    describe_process(child.pid));
+            }
+        }
+    }
+
+    launch_clock::duration threshold_{};
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};  // class HangWatchdog
+
+static double to_ms(launch_clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+/**
+ * The cgroup v2 directory this process is in now, or empty if there isn't
+ * one.
+ */
+static fs::path own_cgroup() {
+    // cgroup v2: '0::/path'.
+    auto cg = std::ifstream("/proc/self/cgroup");
+    for (std::string line; std::getline(cg, line);) {
+        if (boost::starts_with(line, "0::")) {
+            return fs::path("/sys/fs/cgroup") / line.substr(4);
+        }
+    }
+    return {};
+}
+
+/**
+ * Sample system-wide pressure stall information and our cgroup's CPU and
+ * memory accounting at a fixed interval, printing each sample as it's taken
+ * so that the time series lines up with the rest of the output.
+ *
+ * Stall and CPU times are cumulative, so each sample reports them as a
+ * percentage of the interval since the last one.
+ *
+ * The cgroup is looked up again for each sample, so the figures follow the
+ * process into and out of a --cgroup worker cgroup; the first sample after
+ * a move is marked with the new cgroup's name.
+ */
+class PressureSampler {
+   public:
+    PressureSampler(double interval) {
+        if (interval <= 0) {
+            return;
+        }
+        interval_ = std::chrono::duration_cast<launch_clock::duration>(
+            std::chrono::duration<double>(interval));
+        thread_ = std::thread([this]() { Watch(); });
+    }
+    ~PressureSampler() {
+        if (!thread_.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+   private:
+    using Sample = std::map<std::string, double>;
+
+    //! Read 'key value' lines from @p path into @p sample as "prefix.key".
+    static void ReadKeyed(const fs::path& path,
+                          const std::string& prefix,
+                          Sample* sample) {
+        auto f = std::ifstream(path);
+        for (std::string key, value; f >> key >> value;) {
+            (*sample)[prefix + "." + key] = std::atof(value.c_str());
+        }
+    }
+
+    Sample Read() {
+        auto sample = Sample{};
+        // We may have moved into or out of a worker cgroup since the last
+        // sample; its counters don't continue the old one's.
+        auto cgroup = own_cgroup();
+        if (cgroup != cgroup_) {
+            cgroup_ = cgroup;
+            cgroup_changed_ = true;
+        }
+        for (const auto& resource : {"cpu", "memory", "io"}) {
+            // some avg10=0.00 avg60=0.00 avg300=0.00 total=12345
+            auto f = std::ifstream(fs::path("/proc/pressure") / resource);
+            for (std::string line; std::getline(f, line);) {
+                auto total = line.find("total=");
+                if (total != std::string::npos) {
+                    sample[std::string(resource) + "." +
+                           line.substr(0, line.find(' '))] =
+                        std::atof(line.c_str() + total + 6);
+                }
+            }
+        }
+        if (!cgroup_.empty()) {
+            ReadKeyed(cgroup_ / "cpu.stat", "cg.cpu", &sample);
+            ReadKeyed(cgroup_ / "memory.stat", "cg.memory", &sample);
+            auto current = std::ifstream(cgroup_ / "memory.current");
+            if (double bytes; current >> bytes) {
+                sample["cg.memory.current"] = bytes;
+            }
+        }
+        return sample;
+    }
+
+    void Watch() {
+        auto start = launch_clock::now();
+        auto last_time = start;
+        auto last = Read();
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!cv_.wait_for(lock, interval_, [this]() { return stop_; })) {
+            auto now = launch_clock::now();
+            auto sample = Read();
+            auto line = fmt::format(FMT_STRING("pressure t={:.0f}ms"),
+                                    to_ms(now - start));
+            if (cgroup_changed_) {
+                for (auto it = last.begin(); it != last.end();) {
+                    it = boost::starts_with(it->first, "cg.") ? last.erase(it)
+                                                              : std::next(it);
+                }
+                line += " cg=" + cgroup_.filename().native();
+                cgroup_changed_ = false;
+            }
+            auto usecs = std::chrono::duration<double, std::micro>(
+                             now - last_time)
+                             .count();
+            auto pct = [&](const std::string& key) {
+                return sample.count(key) && last.count(key)
+                           ? 100.0 * (sample[key] - last[key]) / usecs
+                           : 0.0;
+            };
+            for (const auto& resource : {"cpu", "memory", "io"}) {
+                auto r = std::string(resource);
+                line += fmt::format(FMT_STRING(" {}={:.1f}/{:.1f}%"), r,
+                                    pct(r + ".some"), pct(r + ".full"));
+            }
+            if (sample.count("cg.cpu.usage_usec")) {
+                line += fmt::format(
+                    FMT_STRING(" cg.cpu={:.1f}% cg.throttled={:.1f}%"),
+                    pct("cg.cpu.usage_usec"), pct("cg.cpu.throttled_usec"));
+            }
+            if (sample.count("cg.memory.current")) {
+                line += fmt::format(
+                    FMT_STRING(" cg.mem={:.0f}kB anon={:.0f}kB "
+                               "file={:.0f}kB kernel={:.0f}kB "
+                               "slab={:.0f}kB"),
+                    sample["cg.memory.current"] / 1024,
+                    sample["cg.memory.anon"] / 1024,
+                    sample["cg.memory.file"] / 1024,
+                    sample["cg.memory.kernel"] / 1024,
+                    sample["cg.memory.slab"] / 1024);
+            }
+            std::cout << line + "\n";
+            last = std::move(sample);
+            last_time = now;
+        }
+    }
+
+    launch_clock::duration interval_{};
+    fs::path cgroup_;
+    bool cgroup_changed_ = false;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};  // class PressureSampler
+
+/**
+ * The first error raised by a pool of worker threads. A worker records it and
+ * returns rather than exiting from under the others, and the thread that
+ * joins the pool reports it with Check().
+ */
+class FirstError {
+   public:
+    //! Record @p msg, unless an error has already been recorded.
+    void Set(std::string msg) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!failed_) {
+            msg_ = std::move(msg);
+            failed_ = true;
+        }
+    }
+    //! Record @p msg with the description of @p syserr, as error_sys() does.
+    void SetSys(int syserr, const std::string& msg) {
+        Set(fmt::format("{}: {}", msg, strerror(syserr)));
+    }
+    //! True once an error has been recorded, so that workers can stop early.
+    bool Failed() const { return failed_; }
+    //! Exit with the recorded error, if there is one.
+    void Check() {
+        if (failed_) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            error(msg_);
+        }
+    }
+
+   private:
+    std::mutex mutex_;
+    std::atomic<bool> failed_{false};
+    std::string msg_;
+};
+
+/**
+ * Call @p fn(i) for each i in [0, n), spread over up to @p workers threads.
+ */
+static void parallel_for(int n,
+                         int workers,
+                         const std::function<void(int)>& fn) {
+    auto next = std::atomic<int>{0};
+    auto pool = std::vector<std::thread>{};
+    workers = std::max(1, std::min(workers, n));
+    for (int w = 0; w < workers; w++) {
+        pool.emplace_back([&]() {
+            for (int i; (i = next++) < n;) {
+                fn(i);
+            }
+        });
+    }
+    for (auto& t : pool) {
+        t.join();
+    }
+}
+
+/**
+ * A fixed-capacity FIFO between pipeline stages. Push() blocks while the
+ * queue is full; Pop() blocks while it's empty, and returns nothing once the
+ * queue is empty and closed.
+ */
+template <typename T>
+class BoundedQueue {
+   public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity_(std::max<size_t>(1, capacity)) {}
+
+    void Push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this]() { return items_.size() < capacity_; });
+        items_.push_back(std::move(item));
+        not_empty_.notify_one();
+    }
+
+    std::optional<T> Pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock,
+                        [this]() { return !items_.empty() || closed_; });
+        if (items_.empty()) {
+            return std::nullopt;
+        }
+        auto item = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return item;
+    }
+
+    //! No more items will be pushed; wake any waiting consumers.
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+   private:
+    size_t capacity_;
+    std::deque<T> items_;
+    bool closed_ = false;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+};  // class BoundedQueue
+
+/**
+ * A snapshot of the kernel's NFS RPC counters: each line of
+ * /proc/net/rpc/nfs and /proc/net/rpc/nfsd, keyed by "nfs <label>" or
+ * "nfsd <label>", and the nfsd thread pool counters summed over pools,
+ * keyed by "pool".
+ */
+using RpcCounters = std::map<std::string, std::vector<double>>;
+
+static RpcCounters read_rpc_counters() {
+    auto counters = RpcCounters{};
+    for (const auto& file : {"nfs", "nfsd"}) {
+        auto f = std::ifstream(fs::path("/proc/net/rpc") / file);
+        for (std::string line; std::getline(f, line);) {
+            auto fields = std::vector<std::string>{};
+            boost::split(fields, line, boost::is_any_of(" "),
+                         boost::token_compress_on);
+            auto& values = counters[std::string(file) + " " + fields[0]];
+            for (size_t i = 1; i < fields.size(); i++) {
+                values.push_back(std::atof(fields[i].c_str()));
+            }
+        }
+    }
+    // # pool packets-arrived sockets-enqueued threads-woken threads-timedout
+    auto pools = std::ifstream("/proc/fs/nfsd/pool_stats");
+    for (std::string line; std::getline(pools, line);) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        auto fields = std::vector<std::string>{};
+        boost::split(fields, line, boost::is_any_of(" "),
+                     boost::token_compress_on);
+        auto& values = counters["pool"];
+        values.resize(std::max(values.size(), fields.size() - 1));
+        for (size_t i = 1; i < fields.size(); i++) {
+            values[i - 1] += std::atof(fields[i].c_str());
+        }
+    }
+    return counters;
+}
+
+//! NFSv4 operation names, indexed by operation number (RFC 8881, 7862,
+//! 8276), as counted in nfsd's proc4ops line.
+static constexpr const char* nfs4_op_names[] = {
+    "op0", "op1", "op2", "ACCESS", "CLOSE", "COMMIT", "CREATE",
+    "DELEGPURGE", "DELEGRETURN", "GETATTR", "GETFH", "LINK", "LOCK",
+    "LOCKT", "LOCKU", "LOOKUP", "LOOKUPP", "NVERIFY", "OPEN", "OPENATTR",
+    "OPEN_CONFIRM", "OPEN_DOWNGRADE", "PUTFH", "PUTPUBFH", "PUTROOTFH",
+    "READ", "READDIR", "READLINK", "REMOVE", "RENAME", "RENEW",
+    "RESTOREFH", "SAVEFH", "SECINFO", "SETATTR", "SETCLIENTID",
+    "SETCLIENTID_CONFIRM", "VERIFY", "WRITE", "RELEASE_LOCKOWNER",
+    "BACKCHANNEL_CTL", "BIND_CONN_TO_SESSION", "EXCHANGE_ID",
+    "CREATE_SESSION", "DESTROY_SESSION", "FREE_STATEID",
+    "GET_DIR_DELEGATION", "GETDEVICEINFO", "GETDEVICELIST", "LAYOUTCOMMIT",
+    "LAYOUTGET", "LAYOUTRETURN", "SECINFO_NO_NAME", "SEQUENCE", "SET_SSV",
+    "TEST_STATEID", "WANT_DELEGATION", "DESTROY_CLIENTID",
+    "RECLAIM_COMPLETE", "ALLOCATE", "COPY", "COPY_NOTIFY", "DEALLOCATE",
+    "IO_ADVISE", "LAYOUTERROR", "LAYOUTSTATS", "OFFLOAD_CANCEL",
+    "OFFLOAD_STATUS", "READ_PLUS", "SEEK", "WRITE_SAME", "CLONE",
+    "GETXATTR", "SETXATTR", "LISTXATTRS", "REMOVEXATTR"};
+
+/**
+ * Report the change in RPC counters since @p before, for phase @p what:
+ * client calls and retransmissions, server calls, the NFSv4 operations the
+ * server executed, and how often a request had to wait for a free nfsd
+ * thread. Does nothing if @p before is empty.
+ */
+static void report_rpc_delta(const std::string& what,
+                             const std::optional<RpcCounters>& before) {
+    if (!before) {
+        return;
+    }
+    auto after = read_rpc_counters();
+    auto delta = [&](const std::string& key, size_t i) {
+        auto a = after.find(key);
+        if (a == after.end() || i >= a->second.size()) {
+            return 0.0;
+        }
+        auto b = before->find(key);
+        auto prev = b != before->end() && i < b->second.size()
+                        ? b->second[i]
+                        : 0.0;
+        return a->second[i] - prev;
+    };
+    // nfs rpc: calls retrans authrefresh
+    std::cout << fmt::format(
+        FMT_STRING("rpc {} client: calls={:.0f} retrans={:.0f} "
+                   "authrefresh={:.0f}\n"),
+        what, delta("nfs rpc", 0), delta("nfs rpc", 1), delta("nfs rpc", 2));
+
+    // nfsd rpc: calls badcalls badfmt badauth badclnt
+    // pool: packets-arrived sockets-enqueued threads-woken threads-timedout
+    auto arrived = delta("pool", 0);
+    auto enqueued = delta("pool", 1);
+    const auto& th = after["nfsd th"];
+    auto threads = th.empty() ? 0.0 : th[0];
+    std::cout << fmt::format(
+        FMT_STRING("rpc {} server: calls={:.0f} badcalls={:.0f} "
+                   "threads={:.0f} arrived={:.0f} waited={:.0f} "
+                   "({:.2f}%) woken={:.0f} timedout={:.0f}\n"),
+        what, delta("nfsd rpc", 0), delta("nfsd rpc", 1), threads, arrived,
+        enqueued, arrived ? 100.0 * enqueued / arrived : 0.0,
+        delta("pool", 2), delta("pool", 3));
+
+    // nfsd proc4ops: count op0 op1 ...
+    auto ops = std::string{};
+    for (size_t op = 0; op < std::size(nfs4_op_names); op++) {
+        if (auto n = delta("nfsd proc4ops", op + 1); n > 0) {
+            ops += fmt::format(FMT_STRING(" {}={:.0f}"), nfs4_op_names[op],
+                               n);
+        }
+    }
+    if (!ops.empty()) {
+        std::cout << fmt::format(FMT_STRING("rpc {} server ops:{}\n"), what,
+                                 ops);
+    }
+}
+
+//! Snapshot the RPC counters if they're being reported.
+static std::optional<RpcCounters> rpc_snapshot(const Context& ctx) {
+    if (!ctx.rpc_stats) {
+        return std::nullopt;
+    }
+    return read_rpc_counters();
+}
+
+/**
+ * Kernel memory counters in kB: Slab and SUnreclaim from /proc/meminfo, and
+ * the total size of each of kmem_caches from /proc/slabinfo.
+ */
+using KernelMemory = std::map<std::string, double>;
+
+//! The slab caches that grow with the number of NFS mounts.
+static constexpr const char* kmem_caches[] = {"nfs_inode_cache", "rpc_tasks",
+                                              "dentry", "mnt_cache"};
+
+static KernelMemory read_kernel_memory() {
+    auto kmem = KernelMemory{};
+    auto meminfo = std::ifstream("/proc/meminfo");
+    for (std::string line; std::getline(meminfo, line);) {
+        // Slab:             123456 kB
+        auto fields = std::vector<std::string>{};
+        boost::split(fields, line, boost::is_any_of(" "),
+                     boost::token_compress_on);
+        if (fields.size() > 1 &&
+            (fields[0] == "Slab:" || fields[0] == "SUnreclaim:")) {
+            kmem[fields[0].substr(0, fields[0].size() - 1)] =
+                std::atof(fields[1].c_str());
+        }
+    }
+    auto slabinfo = std::ifstream("/proc/slabinfo");
+    for (std::string line; std::getline(slabinfo, line);) {
+        // name active_objs num_objs objsize objperslab pagesperslab : ...
+        auto fields = std::vector<std::string>{};
+        boost::split(fields, line, boost::is_any_of(" "),
+                     boost::token_compress_on);
+        if (fields.size() < 4 ||
+            std::find_if(std::begin(kmem_caches), std::end(kmem_caches),
+                         [&fields](const char* c) {
+                             return fields[0] == c;
+                         }) == std::end(kmem_caches)) {
+            continue;
+        }
+        kmem[fields[0]] = std::atof(fields[2].c_str()) *
+                          std::atof(fields[3].c_str()) / 1024;
+    }
+    return kmem;
+}
+
+/**
+ * Report the change in kernel memory from @p before to @p after, and if
+ * @p mounts is non-zero, the change per mount.
+ */
+static void report_kernel_memory(const std::string& what,
+                                 const KernelMemory& before,
+                                 const KernelMemory& after,
+                                 size_t mounts) {
+    auto total = std::string{};
+    auto per_mount = std::string{};
+    for (const auto& [key, kb] : after) {
+        auto srch = before.find(key);
+        auto delta = kb - (srch != before.end() ? srch->second : 0.0);
+        total += fmt::format(FMT_STRING(" {}={:+.0f}"), key, delta);
+        if (mounts) {
+            per_mount +=
+                fmt::format(FMT_STRING(" {}={:+.2f}"), key, delta / mounts);
+        }
+    }
+    std::cout << fmt::format(FMT_STRING("kmem {} (kB):{}\n"), what, total);
+    if (mounts) {
+        std::cout << fmt::format(
+            FMT_STRING("kmem {} per mount (kB, {} mounts):{}\n"), what,
+            mounts, per_mount);
+    }
+}
+
+/**
+ * Counts CPU cycles, task clock, context switches and page faults for this
+ * process and everything it starts after construction, with
+ * perf_event_open(2) and inheritance. Events that can't be opened (e.g. no
+ * hardware PMU in a VM) are skipped.
+ *
+ * Reading a counter sums it over every thread and child that inherited it,
+ * live or exited, so a sample includes both mount helpers and our own
+ * threads. Each sample also has the harness's own share from getrusage(2),
+ * which covers only this process's threads.
+ *
+ * Hardware events may be multiplexed onto the PMU, so each count is read
+ * with the time it was enabled and running, and deltas are scaled up by
+ * their ratio.
+ */
+class PerfCounters {
+   public:
+    using Sample = std::map<std::string, double>;
+
+    PerfCounters() {
+        struct Event {
+            const char* name;
+            uint32_t type;
+            uint64_t config;
+        };
+        for (const auto& event : {
+                 Event{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                 Event{"task-clock", PERF_TYPE_SOFTWARE,
+                       PERF_COUNT_SW_TASK_CLOCK},
+                 Event{"ctx-switches", PERF_TYPE_SOFTWARE,
+                       PERF_COUNT_SW_CONTEXT_SWITCHES},
+                 Event{"page-faults", PERF_TYPE_SOFTWARE,
+                       PERF_COUNT_SW_PAGE_FAULTS}}) {
+            struct perf_event_attr attr {};
+            attr.size = sizeof(attr);
+            attr.type = event.type;
+            attr.config = event.config;
+            attr.inherit = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+                             PERF_FLAG_FD_CLOEXEC);
+            if (fd < 0) {
+                std::cerr << fmt::format(
+                    FMT_STRING("perf: can't count {}: {}\n"), event.name,
+                    strerror(errno));
+                continue;
+            }
+            fds_.emplace_back(event.name, fd);
+        }
+    }
+    ~PerfCounters() {
+        for (const auto& [name, fd] : fds_) {
+            close(fd);
+        }
+    }
+
+    Sample Read() const {
+        auto sample = Sample{};
+        for (const auto& [name, fd] : fds_) {
+            struct {
+                uint64_t value;
+                uint64_t enabled;
+                uint64_t running;
+            } count;
+            if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+                sample[name] = count.value;
+                sample[name + ".enabled"] = count.enabled;
+                sample[name + ".running"] = count.running;
+            }
+        }
+        struct rusage ru {};
+        getrusage(RUSAGE_SELF, &ru);
+        auto ms = [](const timeval& tv) {
+            return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+        };
+        sample["self.cpu"] = ms(ru.ru_utime) + ms(ru.ru_stime);
+        sample["self.ctx-switches"] = ru.ru_nvcsw + ru.ru_nivcsw;
+        sample["self.page-faults"] = ru.ru_minflt + ru.ru_majflt;
+        return sample;
+    }
+
+   private:
+    std::vector<std::pair<std::string, int>> fds_;
+};  // class PerfCounters
+
+//! The perf counters, if the tool's overhead is being reported.
+static std::unique_ptr<PerfCounters> perf_counters;
+
+static std::optional<PerfCounters::Sample> perf_snapshot() {
+    if (!perf_counters) {
+        return std::nullopt;
+    }
+    return perf_counters->Read();
+}
+
+/**
+ * Report the perf counts since @p before for phase @p what, and the
+ * harness's own share of the CPU time. Does nothing if @p before is empty.
+ */
+static void report_perf_delta(
+    const std::string& what,
+    const std::optional<PerfCounters::Sample>& before) {
+    if (!before) {
+        return;
+    }
+    auto after = perf_counters->Read();
+    auto delta = [&](const std::string& key) {
+        auto b = before->find(key);
+        return after[key] - (b != before->end() ? b->second : 0.0);
+    };
+    // Scale up for the part of the phase the event wasn't on the PMU.
+    auto count = [&](const std::string& key) {
+        auto enabled = delta(key + ".enabled");
+        auto running = delta(key + ".running");
+        return running > 0 && running < enabled
+                   ? delta(key) * enabled / running
+                   : delta(key);
+    };
+    auto task_ms = count("task-clock") / 1e6;
+    auto self_ms = delta("self.cpu");
+    auto cycles = after.count("cycles")
+                      ? fmt::format(FMT_STRING(" cycles={:.0f}"),
+                                    count("cycles"))
+                      : std::string{};
+    std::cout << fmt::format(
+        FMT_STRING("perf {}:{} task-clock={:.2f}ms ctx-switches={:.0f} "
+                   "page-faults={:.0f}\n"),
+        what, cycles, task_ms, count("ctx-switches"), count("page-faults"));
+    std::cout << fmt::format(
+        FMT_STRING("perf {} harness: cpu={:.2f}ms ({:.1f}% of task-clock) "
+                   "ctx-switches={:.0f} page-faults={:.0f}\n"),
+        what, self_ms, task_ms > 0 ? 100.0 * self_ms / task_ms : 0.0,
+        delta("self.ctx-switches"), delta("self.page-faults"));
+}
+
+/**
+ * A named, timed phase of the run. The phase ends when End() is called or
+ * the object is destroyed, and its duration is printed then.
+ */
+class Phase {
+   public:
+    Phase(const Context& ctx, std::string name)
+        : ctx_(ctx),
+          name_(std::move(name)),
+          rpc_(rpc_snapshot(ctx)),
+          perf_(perf_snapshot()),
+          start_(launch_clock::now()) {
+        VERBOSE(ctx_, "begin phase {}", name_);
+    }
+    ~Phase() { End(); }
+
+    void End() {
+        if (ended_) {
+            return;
+        }
+        ended_ = true;
+        auto end = launch_clock::now();
+        std::cout << fmt::format(FMT_STRING("phase {} (ms): {:.2f}\n"), name_,
+                                 to_ms(end - start_));
+        if (tracer) {
+            tracer->Span(name_, "phase", Tracer::pid_threads, gettid(),
+                         start_, end);
+        }
+        report_rpc_delta(name_, rpc_);
+        report_perf_delta(name_, perf_);
+    }
+
+   private:
+    const Context& ctx_;
+    std::string name_;
+    std::optional<RpcCounters> rpc_;
+    std::optional<PerfCounters::Sample> perf_;
+    launch_clock::time_point start_;
+    bool ended_ = false;
+};  // class Phase
+
+/**
+ * Move into a new mount namespace with private propagation, so our mounts
+ * neither propagate to the host's peer groups nor outlive the process.
+ *
+ * unshare(CLONE_NEWNS) fails in a multithreaded process, so this must run
+ * before any threads are started.
+ *
+ * Note that nfsd resolves export paths in the host namespace, so it sees the
+ * plain directories underneath our private bind mounts.
+ */
+static void enter_private_namespace(const Context& ctx) {
+    if (unshare(CLONE_NEWNS) < 0) {
+        EFMT_SYS(errno, "Failed to create mount namespace");
+    }
+    if (mount("none", "/", nullptr, MS_REC | MS_PRIVATE, nullptr) < 0) {
+        EFMT_SYS(errno, "Failed to make mounts private");
+    }
+    VERBOSE(ctx, "Entered private mount namespace");
+}
+
+/**
+ * Write @p value to a cgroup, tracefs or procfs control file @p path.
+ *
+ * @return 0 on success, otherwise an errno value.
+ */
+static int write_control(const fs::path& path, const std::string& value) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+    int err = write(fd, value.data(), value.size()) < 0 ? errno : 0;
+    close(fd);
+    return err;
+}
+
+/**
+ * A cgroup v2 child for the mount workload, with optional CPU, memory and
+ * I/O limits.
+ *
+ * Mount helpers can't be spawned directly into a cgroup here, so Enter()
+ * moves this whole process in, and every helper and launcher thread
+ * started afterwards inherits it; Leave() moves it back, so that teardown
+ * isn't limited. Remove() removes the cgroup, as does destruction; cleanup
+ * calls it, since an error exits without destroying anything.
+ */
+class WorkerCgroup {
+   public:
+    WorkerCgroup(const Context& ctx)
+        : ctx_(ctx),
+          dir_(fs::path(ctx.cgroup_parent) / ctx.cgroup),
+          home_(own_cgroup()) {
+        if (home_.empty()) {
+            EFMT("Not in a cgroup v2 hierarchy");
+        }
+        // The parent has to delegate each controller we set limits for.
+        auto controllers = std::string{};
+        if (ctx.cpu_quota > 0) {
+            controllers += " +cpu";
+        }
+        if (!ctx.memory_max.empty()) {
+            controllers += " +memory";
+        }
+        if (!ctx.io_max.empty()) {
+            controllers += " +io";
+        }
+        if (!controllers.empty()) {
+            auto subtree =
+                fs::path(ctx.cgroup_parent) / "cgroup.subtree_control";
+            if (int err = write_control(subtree, controllers.substr(1))) {
+                EFMT_SYS(err, "Failed to enable{} in {}", controllers,
+                         subtree.native());
+            }
+        }
+        // create_directory() reports an existing directory by returning
+        // false, without an error.
+        std::error_code ec;
+        if (!fs::create_directory(dir_, ec)) {
+            if (!ec) {
+                EFMT("cgroup {} already exists", dir_.native());
+            }
+            EFMT_SYS(ec.value(), "Failed to create cgroup {}", dir_.native());
+        }
+        created_ = true;
+        if (ctx.cpu_quota > 0) {
+            // cpu.max: quota and period in microseconds.
+            auto period = 100000;
+            SetLimit("cpu.max",
+                     fmt::format(FMT_STRING("{} {}"),
+                                 static_cast<long>(ctx.cpu_quota * period),
+                                 period));
+        }
+        if (!ctx.memory_max.empty()) {
+            SetLimit("memory.max", ctx.memory_max);
+        }
+        if (!ctx.io_max.empty()) {
+            SetLimit("io.max", ctx.io_max);
+        }
+    }
+    ~WorkerCgroup() {
+        Leave();
+        Remove();
+    }
+
+    void Enter() {
+        if (int err = write_control(dir_ / "cgroup.procs",
+                                    std::to_string(getpid()))) {
+            EFMT_SYS(err, "Failed to move into cgroup {}", dir_.native());
+        }
+        entered_ = true;
+        VERBOSE(ctx_, "Entered cgroup {}", dir_.native());
+    }
+
+    void Leave() {
+        if (!entered_) {
+            return;
+        }
+        if (int err = write_control(home_ / "cgroup.procs",
+                                    std::to_string(getpid()))) {
+            std::cerr << fmt::format(
+                FMT_STRING("Failed to move back to cgroup {}: {}\n"),
+                home_.native(), strerror(err));
+        }
+        entered_ = false;
+    }
+
+    //! Remove the cgroup, once. Leave() it first.
+    void Remove() {
+        if (!created_) {
+            return;
+        }
+        if (rmdir(dir_.c_str()) < 0) {
+            VERBOSE(ctx_, "Failed to remove cgroup {}: {}", dir_.native(),
+                    strerror(errno));
+        }
+        created_ = false;
+    }
+
+    //! Report the cgroup's CPU, memory and I/O accounting.
+    void Report() {
+        auto keyed = [this](const char* file) {
+            auto values = std::map<std::string, double>{};
+            auto f = std::ifstream(dir_ / file);
+            for (std::string key, value; f >> key >> value;) {
+                values[key] = std::atof(value.c_str());
+            }
+            return values;
+        };
+        auto cpu = keyed("cpu.stat");
+        std::cout << fmt::format(
+            FMT_STRING("cgroup {} cpu (ms): usage={:.1f} user={:.1f} "
+                       "system={:.1f} throttled={:.1f} in {:.0f}/{:.0f} "
+                       "periods\n"),
+            ctx_.cgroup, cpu["usage_usec"] / 1000, cpu["user_usec"] / 1000,
+            cpu["system_usec"] / 1000, cpu["throttled_usec"] / 1000,
+            cpu["nr_throttled"], cpu["nr_periods"]);
+        auto peak = std::ifstream(dir_ / "memory.peak");
+        if (double bytes; peak >> bytes) {
+            auto events = keyed("memory.events");
+            std::cout << fmt::format(
+                FMT_STRING("cgroup {} memory: peak={:.0f}kB max={:.0f} "
+                           "oom={:.0f} oom_kill={:.0f}\n"),
+                ctx_.cgroup, bytes / 1024, events["max"], events["oom"],
+                events["oom_kill"]);
+        }
+        // MAJ:MIN rbytes=... wbytes=... rios=... wios=... ...
+        auto io = std::ifstream(dir_ / "io.stat");
+        for (std::string line; std::getline(io, line);) {
+            std::cout << fmt::format(FMT_STRING("cgroup {} io: {}\n"),
+                                     ctx_.cgroup, line);
+        }
+    }
+
+   private:
+    void SetLimit(const std::string& file, const std::string& value) {
+        if (int err = write_control(dir_ / file, value)) {
+            // This is before cleanup is set up, so remove it here.
+            Remove();
+            EFMT_SYS(err, "Failed to set {} '{}' on {}", file, value,
+                     dir_.native());
+        }
+        VERBOSE(ctx_, "cgroup {} {}={}", ctx_.cgroup, file, value);
+    }
+
+    const Context& ctx_;
+    fs::path dir_;
+    fs::path home_;
+    bool created_ = false;
+    bool entered_ = false;
+};  // class WorkerCgroup
+
+/**
+ * Lazily detach every mount at or below @p root, deepest first, except those
+ * at or below @p keep. Only used on mounts nothing else should be using; the
+ * kernel finishes the teardown once they're no longer busy.
+ */
+static void detach_mounts_under(const Context& ctx,
+                                const fs::path& root,
+                                const fs::path& keep = {}) {
+    auto within = [](const std::string& target, const fs::path& dir) {
+        return target == dir.native() ||
+               boost::starts_with(target, dir.native() + "/");
+    };
+    auto mstr = std::ifstream("/proc/self/mounts");
+    auto targets = std::vector<std::string>{};
+    for (std::string line; std::getline(mstr, line);) {
+        auto fields = std::vector<std::string>{};
+        boost::split(fields, line, boost::is_any_of(" "),
+                     boost::token_compress_on);
+        if (fields.size() > 1 && within(fields[1], root) &&
+            (keep.empty() || !within(fields[1], keep))) {
+            targets.push_back(fields[1]);
+        }
+    }
+    // Later mounts may be stacked on earlier ones.
+    for (auto it = targets.rbegin(); it != targets.rend(); ++it) {
+        if (umount2(it->c_str(), MNT_DETACH) < 0) {
+            VERBOSE(ctx, "Failed to detach {}: {}", *it, strerror(errno));
+        }
+    }
+}
+
+/**
+ * The results of one wave of concurrent helpers, in launch order.
+ */
+struct WaveResult {
+    std::vector<MountOutcome> outcomes;
+    launch_clock::time_point start{};
+    launch_clock::time_point end{};
+    int failures = 0;
+};
+
+/**
+ * Run every command in @p argvs concurrently, using the launcher chosen in
+ * ctx, and wait for them all (including retries) to finish.
+ */
+static WaveResult run_wave(
+    const Context& ctx,
+    const std::vector<std::vector<std::string>>& argvs) {
+    using mountfut = std::future<MountOutcome>;
+    auto mounters = std::vector<mountfut>{};
+    auto wave = WaveResult{};
+    int n = static_cast<int>(argvs.size());
+
+    auto watchdog = HangWatchdog(ctx.hang_threshold);
+    // Only used by the thread launcher. It must outlive the futures, not
+    // just the launch loop: when our wait() returns, mounter threads may
+    // still be inside theirs.
+    auto start_barrier = boost::barrier(n + 1);
+
+    if (ctx.launcher == "epoll") {
+        // One reaper thread for every helper.
+        auto launcher = Launcher(launcher_warn(ctx));
+        wave.start = launch_clock::now();
+        for (int d = 0; d < n; d++) {
+            VERBOSE(ctx, "Launch mounter {}", d);
+            mounters.push_back(launch_with_retry(ctx, launcher, argvs[d]));
+        }
+        // ~Launcher() waits for all of them, including retries.
+    } else {
+        for (int d = 0; d < n; d++) {
+            VERBOSE(ctx, "Start mounter {}", d);
+            mounters.emplace_back(std::async(
+                std::launch::async,
+                [argv = argvs[d], ctx, d, &start_barrier]() {
+                    start_barrier.wait();
+                    VERBOSE(ctx, "mounter {} cmd '{}'", d,
+                            boost::algorithm::join(argv, " "));
+                    return run_with_retry(ctx, argv);
+                }));
+        }
+
+        // Start the clock once every mounter thread exists and the barrier
+        // releases them, so that thread creation isn't counted.
+        start_barrier.wait();
+        wave.start = launch_clock::now();
+    }
+
+    wave.end = wave.start;
+    for (auto& future : mounters) {
+        auto outcome = future.get();
+        wave.failures += !outcome.result.Success();
+        wave.end = std::max(wave.end, outcome.result.end);
+        wave.outcomes.push_back(std::move(outcome));
+    }
+    return wave;
+}
+
+/**
+ * Add a span for each of a wave's helpers, covering any retries, on the
+ * track for its index in the wave.
+ */
+static void trace_wave(const std::string& what, const WaveResult& wave) {
+    if (!tracer) {
+        return;
+    }
+    for (size_t d = 0; d < wave.outcomes.size(); d++) {
+        const auto& outcome = wave.outcomes[d];
+        const auto& r = outcome.result;
+        tracer->Span(
+            what, "mount", Tracer::pid_mounts, d, outcome.start, r.end,
+            fmt::format(FMT_STRING("{{\"index\":{},\"attempts\":{},"
+                                   "\"ok\":{},\"exit\":{}}}"),
+                        d, outcome.attempts, r.Success(), r.exit_code));
+    }
+}
+
+/**
+ * Report a wave's latency, and its failures by class against the wave's
+ * concurrency, and trace it. @p what labels the output lines.
+ */
+static void report_wave(const Context& ctx,
+                        const std::string& what,
+                        const WaveResult& wave) {
+    int timeouts = 0, wedged = 0, retried = 0;
+    int n = static_cast<int>(wave.outcomes.size());
+    auto by_class = std::map<FailureClass, int>{};
+    auto elapsed = std::vector<launch_clock::duration>{};
+    for (int d = 0; d < n; d++) {
+        const auto& outcome = wave.outcomes[d];
+        const auto& r = outcome.result;
+        if (!r.Success()) {
+            auto fc = classify_failure(r);
+            by_class[fc]++;
+            VERBOSE(ctx,
+                    "{} {} failed ({}): error {} exit {} signal {} "
+                    "stderr '{}'",
+                    what, d, failure_class_name(fc), r.error, r.exit_code,
+                    r.signal, boost::trim_copy(r.err_output));
+        }
+        timeouts += r.timed_out;
+        wedged += r.wedged;
+        retried += outcome.attempts > 1;
+        elapsed.push_back(outcome.Elapsed());
+    }
+    if (wave.failures) {
+        std::cerr << fmt::format(FMT_STRING("Got {} {} failures\n"),
+                                 wave.failures, what);
+    }
+    if (timeouts || wedged || retried) {
+        std::cerr << fmt::format(
+            FMT_STRING("{}: {} retried, {} timed out, {} wedged\n"), what,
+            retried, timeouts, wedged);
+    }
+    report_latency(what, elapsed, wave.end - wave.start);
+    auto rates = std::string{};
+    for (auto fc : failure_classes) {
+        rates += fmt::format(FMT_STRING(" {}={:.2f}%"),
+                             failure_class_name(fc),
+                             n ? 100.0 * by_class[fc] / n : 0.0);
+    }
+    std::cout << fmt::format(
+        FMT_STRING("{} failures at concurrency {}: {}/{}{}\n"), what, n,
+        wave.failures, n, rates);
+    trace_wave(what, wave);
+}
+
+/**
+ * Scan /proc/self/mounts until at least @p expected NFS mounts show up (or
+ * we're interrupted), checking each against the mount-to-mountpoint map.
+ *
+ * @return The number of NFS mounts found.
+ */
+static size_t verify_mounts(
+    const Context& ctx,
+    const std::unordered_map<std::string, std::string>& m_to_c,
+    int expected) {
+    size_t nmounts = 0;
+    do {
+        // Scan /proc/mounts.
+        VERBOSE(ctx, "Scan mounts");
+        auto span = TraceSpan("verify scan", "verify");
+        auto mstr = std::ifstream{};
+        auto old_e = mstr.exceptions();
+        mstr.exceptions(std::iostream::failbit);
+        mstr.open("/proc/self/mounts");
+        mstr.exceptions(old_e);
+
+        auto mline = std::vector<std::string>{};
+        for (std::string line; std::getline(mstr, line);)
+            mline.push_back(line);
+        mstr.close();
+
+        nmounts = 0;
+        for (const auto& mount : mline) {
+            auto fields = std::vector<std::string>{};
+            // fields:
+            // 0      1          2          3       4        5
+            // device mountpoint filesystem options dontcare dontcare
+            boost::split(fields, mount, boost::is_any_of(" "),
+                         boost::token_compress_on);
+            if (fields[2] != "nfs" && fields[2] != "nfs4") {
+                continue;
+            }
+            nmounts++;
+
+            // Check mount-to-client-mountpoint.
+            auto m = fields[0];
+            auto c = fields[1];
+            auto srch = m_to_c.find(m);
+            if (srch == m_to_c.end()) {
+                EFMT("Mount '{}' not found in map", m);
+            }
+            if (srch->second != c) {
+                EFMT("Mount '{}' expected mountpoint {} found {}", m, c,
+                     srch->second);
+            }
+        }
+        // Failed mounts won't show up, so don't wait for them.
+    } while (cleanup && nmounts < static_cast<size_t>(std::max(0, expected)));
+    return nmounts;
+}
+
+/**
+ * The per-mount directory names, relative to each of the mount, export and
+ * client roots. The flat layout puts them all directly in the root; the
+ * sharded layout puts ctx.shard_size of them in each shard directory, which
+ * are returned in @p shards so they can be created first. Numbers are
+ * zero-padded to a common width so names sort in mount order.
+ */
+static std::vector<fs::path> layout_dirnames(const Context& ctx,
+                                             std::vector<fs::path>* shards) {
+    auto digits = [](int n) {
+        return static_cast<int>(std::to_string(std::max(0, n - 1)).size());
+    };
+    auto sharded = ctx.layout == "sharded";
+    auto width = std::max(sharded ? 6 : 4, digits(ctx.threads));
+    auto nshards = (ctx.threads + ctx.shard_size - 1) / ctx.shard_size;
+    auto swidth = std::max(2, digits(nshards));
+
+    shards->clear();
+    if (sharded) {
+        for (int s = 0; s < nshards; s++) {
+            shards->push_back(fmt::format(FMT_STRING("s{:0{}}"), s, swidth));
+        }
+    }
+    auto names = std::vector<fs::path>{};
+    for (int d = 0; d < ctx.threads; d++) {
+        auto leaf = fmt::format(FMT_STRING("d{:0{}}"), d, width);
+        if (sharded) {
+            names.push_back((*shards)[d / ctx.shard_size] / leaf);
+        } else {
+            names.push_back(leaf);
+        }
+    }
+    return names;
+}
+
+/**
+ * Everything needed to run the client side of the test repeatedly: the
+ * mount and unmount commands, and the expected mount-to-mountpoint map.
+ */
+struct Workload {
+    fs::path clientdir;
+    fs::path churndir;
+    std::vector<std::vector<std::string>> mount_argvs;
+    std::vector<std::vector<std::string>> umount_argvs;
+    std::unordered_map<std::string, std::string> m_to_c;
+};
+
+/**
+ * Per-operation RPC counters from /proc/self/mountstats, summed over
+ * mounts. Times are cumulative milliseconds; `queue` is the time spent on
+ * the transport backlog before transmission.
+ */
+struct OpStats {
+    uint64_t ops = 0;
+    uint64_t trans = 0;
+    uint64_t timeouts = 0;
+    uint64_t queue = 0;
+    uint64_t rtt = 0;
+    uint64_t execute = 0;
+};
+
+/**
+ * Transport counters from /proc/self/mountstats, summed over transports.
+ * `req_u` and `bklog_u` are the slot table and backlog queue lengths summed
+ * at each send, so divided by `sends` they give the mean utilisation.
+ */
+struct XprtStats {
+    int xprts = 0;
+    uint64_t sends = 0;
+    uint64_t recvs = 0;
+    uint64_t bad_xids = 0;
+    uint64_t req_u = 0;
+    uint64_t bklog_u = 0;
+    uint64_t max_slots = 0;
+};
+
+struct MountStats {
+    int mounts = 0;
+    std::map<std::string, OpStats> ops;
+    XprtStats xprt;
+};
+
+/**
+ * Read and sum the RPC statistics of every NFS mount at or below @p root.
+ *
+ * Mounts of the same server share a transport, so each transport (told
+ * apart by its source port) is only counted once.
+ */
+static MountStats read_mountstats(const fs::path& root) {
+    auto stats = MountStats{};
+    auto ms = std::ifstream("/proc/self/mountstats");
+    auto ports = std::set<std::string>{};
+    bool ours = false, per_op = false;
+    for (std::string line; std::getline(ms, line);) {
+        auto fields = std::vector<std::string>{};
+        boost::trim(line);
+        boost::split(fields, line, boost::is_any_of(" \t"),
+                     boost::token_compress_on);
+        auto num = [&fields](size_t i) -> uint64_t {
+            return i < fields.size() ? std::stoull(fields[i]) : 0;
+        };
+        // fields:
+        // 0      1      2       3  4          5    6      7
+        // device remote mounted on mountpoint with fstype type ...
+        if (fields[0] == "device") {
+            ours = fields.size() > 7 && boost::starts_with(fields[7], "nfs") &&
+                   (fields[4] == root.native() ||
+                    boost::starts_with(fields[4], root.native() + "/"));
+            per_op = false;
+            stats.mounts += ours;
+            continue;
+        }
+        if (!ours) {
+            continue;
+        }
+        if (fields[0] == "xprt:" && fields.size() > 2) {
+            // tcp: port bind_count connect_count connect_time idle_time
+            //      sends recvs bad_xids req_u bklog_u max_slots ...
+            // udp: port bind_count sends recvs bad_xids req_u bklog_u
+            //      max_slots ...
+            auto key = fields[1] + ":" + fields[2];
+            if (!ports.insert(key).second) {
+                continue;
+            }
+            size_t base = fields[1] == "udp" ? 4 : 7;
+            auto& x = stats.xprt;
+            x.xprts++;
+            x.sends += num(base);
+            x.recvs += num(base + 1);
+            x.bad_xids += num(base + 2);
+            x.req_u += num(base + 3);
+            x.bklog_u += num(base + 4);
+            x.max_slots = std::max(x.max_slots, num(base + 5));
+        } else if (line == "per-op statistics") {
+            per_op = true;
+        } else if (per_op && fields.size() >= 9 &&
+                   boost::ends_with(fields[0], ":")) {
+            // name: ops trans timeouts bytes_sent bytes_recv queue rtt
+            //       execute ...
+            auto& op = stats.ops[fields[0].substr(0, fields[0].size() - 1)];
+            op.ops += num(1);
+            op.trans += num(2);
+            op.timeouts += num(3);
+            op.queue += num(6);
+            op.rtt += num(7);
+            op.execute += num(8);
+        }
+    }
+    return stats;
+}
+
+/**
+ * Report the RPC statistics of the client mounts: per-operation counts and
+ * mean backlog, round-trip and execute times, and transport utilisation.
+ * High RTT points at the server; queue time and backlog utilisation well
+ * above it point at client-side queueing.
+ */
+static void report_mountstats(const std::string& tag, const fs::path& root) {
+    auto stats = read_mountstats(root);
+    const auto& x = stats.xprt;
+    auto per_send = [&x](uint64_t v) {
+        return x.sends ? static_cast<double>(v) / x.sends : 0.0;
+    };
+    std::cout << fmt::format(
+        FMT_STRING("mountstats{}: mounts={} xprts={} sends={} recvs={} "
+                   "bad_xids={} req_u={:.2f} bklog_u={:.2f} "
+                   "max_slots={}\n"),
+        tag, stats.mounts, x.xprts, x.sends, x.recvs, x.bad_xids,
+        per_send(x.req_u), per_send(x.bklog_u), x.max_slots);
+    for (const auto& [name, op] : stats.ops) {
+        if (op.ops == 0) {
+            continue;
+        }
+        auto mean = [&op](uint64_t v) {
+            return static_cast<double>(v) / op.ops;
+        };
+        std::cout << fmt::format(
+            FMT_STRING("mountstats{} {}: ops={} trans={} timeouts={} "
+                       "queue={:.2f} rtt={:.2f} execute={:.2f} (ms/op)\n"),
+            tag, name, op.ops, op.trans, op.timeouts, mean(op.queue),
+            mean(op.rtt), mean(op.execute));
+    }
+}
+
+/**
+ * Report the number of entries in nfsd's export-related sunrpc caches. How
+ * these grow with the mount count differs between a single pseudo-root
+ * export and per-directory exports.
+ */
+static void report_export_cache(const std::string& tag) {
+    auto line = std::string{};
+    for (const auto& cache : {"nfsd.export", "nfsd.fh", "auth.unix.ip"}) {
+        auto content = std::ifstream(fs::path("/proc/net/rpc") / cache /
+                                     "content");
+        if (!content) {
+            continue;
+        }
+        size_t entries = 0;
+        for (std::string l; std::getline(content, l);) {
+            entries += !l.empty() && l[0] != '#';
+        }
+        line += fmt::format(FMT_STRING(" {}={}"), cache, entries);
+    }
+    if (!line.empty()) {
+        std::cout << fmt::format(FMT_STRING("export cache{}:{}\n"), tag,
+                                 line);
+    }
+}
+
+/**
+ * Find the tracefs instances directory.
+ *
+ * @return The path, or empty if tracefs isn't mounted.
+ */
+static fs::path tracefs_instances() {
+    for (const auto& root :
+         {"/sys/kernel/tracing", "/sys/kernel/debug/tracing"}) {
+        if (fs::is_directory(fs::path(root) / "instances")) {
+            return fs::path(root) / "instances";
+        }
+    }
+    return {};
+}
+
+/**
+ * Break mount latency down by RPC, from the client's tracepoints.
+ *
+ * For its lifetime, a private tracefs instance has sunrpc:rpc_stats_latency
+ * and the nfs4 client ID, session and root lookup events enabled. The
+ * former fires as each RPC completes and gives its procedure, e.g.
+ * EXCHANGE_ID, CREATE_SESSION, LOOKUP_ROOT (PUTROOTFH) or GETATTR, along
+ * with its backlog, RTT and execute times. The nfs4 events are only counted
+ * where they report an error. The per-inode nfs and nfs4 events are left
+ * off, as their volume would perturb the wave. A reader thread drains
+ * trace_pipe as events arrive, so a small ring will do.
+ *
+ * A mount helper's synchronous RPCs complete in its own context, so RPCs
+ * are joined to mounts by the pid of the mount.nfs that issued them. Work
+ * done for the mount by other threads, e.g. the state manager, is still
+ * counted per procedure but not per mount.
+ *
+ * Live instances are registered so that RemoveAll() can take them down
+ * from cleanup, however the run ends; a leftover instance would keep
+ * tracing and perturb later runs.
+ */
+class RpcTracepoints {
+   public:
+    RpcTracepoints(const Context& ctx) : ctx_(ctx) {
+        instance_ = tracefs_instances() /
+                    fmt::format(FMT_STRING("paramount.{}"), getpid());
+        std::error_code ec;
+        fs::create_directory(instance_, ec);
+        if (ec) {
+            EFMT_SYS(ec.value(), "Failed to create trace instance {}",
+                     instance_.native());
+        }
+        {
+            std::lock_guard<std::mutex> lock(live_mutex_);
+            live_.insert(this);
+        }
+        // Optional: the reader keeps the default ring drained, and any
+        // overrun is reported as lost events.
+        if (auto err = write_control(instance_ / "buffer_size_kb", "1024")) {
+            VERBOSE(ctx_, "Failed to size trace buffer: {}", strerror(err));
+        }
+        pipe_ = open((instance_ / "trace_pipe").c_str(),
+                     O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (pipe_ < 0) {
+            EFMT_SYS(errno, "Failed to open {}/trace_pipe",
+                     instance_.native());
+        }
+        auto events = instance_ / "events";
+        auto latency = events / "sunrpc/rpc_stats_latency/enable";
+        if (auto err = write_control(latency, "1")) {
+            EFMT_SYS(err, "Failed to enable {}", latency.native());
+        }
+        // Which of these exist depends on the kernel and NFS version.
+        for (const auto& event :
+             {"nfs4_setclientid", "nfs4_setclientid_confirm",
+              "nfs4_exchange_id", "nfs4_create_session",
+              "nfs4_reclaim_complete", "nfs4_lookup_root"}) {
+            auto path = events / "nfs4" / event / "enable";
+            if (auto err = write_control(path, "1")) {
+                VERBOSE(ctx_, "Can't enable {}: {}", event, strerror(err));
+            }
+        }
+        start_ = launch_clock::now();
+        thread_ = std::thread([this]() { Drain(); });
+    }
+    ~RpcTracepoints() {
+        Stop();
+        {
+            std::lock_guard<std::mutex> lock(live_mutex_);
+            live_.erase(this);
+        }
+        Remove();
+    }
+
+    //! Stop and remove every live instance, e.g. on interrupt.
+    static void RemoveAll() {
+        std::lock_guard<std::mutex> lock(live_mutex_);
+        for (auto* tp : live_) {
+            tp->Stop();
+            tp->Remove();
+        }
+    }
+
+    //! Stop tracing and wait for the reader to drain what's left.
+    void Stop() {
+        if (stopped_.exchange(true)) {
+            return;
+        }
+        end_ = launch_clock::now();
+        write_control(instance_ / "tracing_on", "0");
+        stop_ = true;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        if (pipe_ >= 0) {
+            close(pipe_);
+            pipe_ = -1;
+        }
+        // Events lost to a full ring.
+        std::error_code ec;
+        for (const auto& cpu :
+             fs::directory_iterator(instance_ / "per_cpu", ec)) {
+            auto stats = std::ifstream(cpu.path() / "stats");
+            for (std::string key; stats >> key;) {
+                if (key == "overrun:") {
+                    uint64_t n = 0;
+                    stats >> n;
+                    overruns_ += n;
+                }
+            }
+        }
+    }
+
+    void Report(const std::string& tag) {
+        size_t rpcs = 0;
+        for (const auto& [name, rpc] : procs_) {
+            rpcs += rpc.execute.size();
+        }
+        std::cout << fmt::format(
+            FMT_STRING("rpc trace{}: events={} lost={} rpcs={} mounts={} "
+                       "over {:.2f}ms\n"),
+            tag, events_, overruns_, rpcs, mounts_.size(),
+            to_ms(end_ - start_));
+        for (auto& [name, rpc] : procs_) {
+            auto n = rpc.execute.size();
+            std::sort(rpc.execute.begin(), rpc.execute.end());
+            auto pct = [&rpc, n](double p) {
+                return rpc.execute[static_cast<size_t>(p / 100.0 * (n - 1) +
+                                                       0.5)] /
+                       1000.0;
+            };
+            auto mean = [n](uint64_t us) {
+                return static_cast<double>(us) / n / 1000.0;
+            };
+            std::cout << fmt::format(
+                FMT_STRING("rpc trace{} {}: n={} backlog={:.3f} rtt={:.3f} "
+                           "execute={:.3f} p50={:.3f} p99={:.3f} "
+                           "max={:.3f} (ms)\n"),
+                tag, name, n, mean(rpc.backlog), mean(rpc.rtt),
+                mean(std::accumulate(rpc.execute.begin(),
+                                     rpc.execute.end(), uint64_t{0})),
+                pct(50), pct(99), rpc.execute.back() / 1000.0);
+        }
+
+        // Each procedure's share of the time mount helpers spent in RPCs,
+        // and how many mounts it was the slowest step of.
+        if (mounts_.empty()) {
+            return;
+        }
+        struct Stage {
+            size_t mounts = 0;
+            size_t dominant = 0;
+            uint64_t us = 0;
+        };
+        auto stages = std::map<std::string, Stage>{};
+        uint64_t total = 0;
+        for (const auto& [pid, procs] : mounts_) {
+            auto slowest = procs.begin();
+            for (auto it = procs.begin(); it != procs.end(); ++it) {
+                stages[it->first].mounts++;
+                stages[it->first].us += it->second;
+                total += it->second;
+                if (it->second > slowest->second) {
+                    slowest = it;
+                }
+            }
+            stages[slowest->first].dominant++;
+        }
+        auto order = std::vector<std::pair<std::string, Stage>>(
+            stages.begin(), stages.end());
+        std::stable_sort(order.begin(), order.end(),
+                         [](const auto& a, const auto& b) {
+                             return a.second.us > b.second.us;
+                         });
+        std::cout << fmt::format(
+            FMT_STRING("rpc trace{} per mount: {:.3f}ms in RPCs\n"), tag,
+            total / 1000.0 / mounts_.size());
+        for (const auto& [name, stage] : order) {
+            std::cout << fmt::format(
+                FMT_STRING("rpc trace{} per mount {}: {:.3f}ms share={:.1f}% "
+                           "in={} slowest={}\n"),
+                tag, name, stage.us / 1000.0 / mounts_.size(),
+                total ? 100.0 * stage.us / total : 0.0, stage.mounts,
+                stage.dominant);
+        }
+        for (const auto& [what, count] : errors_) {
+            std::cout << fmt::format(FMT_STRING("rpc trace{} {}: {}\n"), tag,
+                                     what, count);
+        }
+    }
+
+   private:
+    //! Remove the instance, which frees its ring and disables its events.
+    void Remove() {
+        std::error_code ec;
+        fs::remove(instance_, ec);
+        if (ec) {
+            VERBOSE(ctx_, "Failed to remove trace instance {}: {}",
+                    instance_.native(), ec.message());
+        }
+    }
+
+    struct Procedure {
+        uint64_t backlog = 0;
+        uint64_t rtt = 0;
+        std::vector<uint64_t> execute;  // us
+    };
+
+    void Drain() {
+        char buf[65536];
+        auto partial = std::string{};
+        for (;;) {
+            // Tracing is off once stop_ is set, so an empty read after
+            // that means we're done.
+            bool stopping = stop_;
+            auto pfd = pollfd{pipe_, POLLIN, 0};
+            poll(&pfd, 1, 100);
+            auto n = read(pipe_, buf, sizeof(buf));
+            if (n > 0) {
+                partial.append(buf, n);
+                size_t start = 0;
+                for (auto nl = partial.find('\n'); nl != std::string::npos;
+                     nl = partial.find('\n', start)) {
+                    Parse(partial.substr(start, nl - start));
+                    start = nl + 1;
+                }
+                partial.erase(0, start);
+                continue;
+            }
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                VERBOSE(ctx_, "trace_pipe read failed: {}", strerror(errno));
+                break;
+            }
+            if (stopping) {
+                break;
+            }
+        }
+    }
+
+    /**
+     * Parse one trace_pipe line, e.g.
+     *
+     *   mount.nfs-1234 [003] ..... 5.678: rpc_stats_latency: task:...
+     *     xid=0x... nfsv4 EXCHANGE_ID backlog=12 rtt=345 execute=400
+     *   mount.nfs-1234 [003] ..... 5.679: nfs4_lookup_root: error=-2
+     *     (ENOENT) ...
+     */
+    void Parse(const std::string& line) {
+        auto bracket = line.find(" [");
+        auto colon = line.find(": ", bracket);
+        if (bracket == std::string::npos || colon == std::string::npos) {
+            return;
+        }
+        auto rest = line.substr(colon + 2);
+        auto event = rest.substr(0, rest.find(':'));
+        events_++;
+        if (event != "rpc_stats_latency") {
+            auto e = rest.find("error=-");
+            if (e != std::string::npos) {
+                errors_[event + " " +
+                        rest.substr(e, rest.find(')', e) + 1 - e)]++;
+            }
+            return;
+        }
+        // Skip the task and xid, and the program ("nfsv4").
+        auto fields = std::istringstream(rest.substr(event.size() + 1));
+        std::string task, xid, prog, proc;
+        fields >> task >> xid >> prog >> proc;
+        uint64_t backlog = 0, rtt = 0, execute = 0;
+        for (std::string kv; fields >> kv;) {
+            auto eq = kv.find('=');
+            if (eq == std::string::npos) {
+                continue;
+            }
+            auto key = kv.substr(0, eq);
+            auto value = std::strtoull(kv.c_str() + eq + 1, nullptr, 10);
+            if (key == "backlog") {
+                backlog = value;
+            } else if (key == "rtt") {
+                rtt = value;
+            } else if (key == "execute") {
+                execute = value;
+            }
+        }
+        auto& p = procs_[proc];
+        p.backlog += backlog;
+        p.rtt += rtt;
+        p.execute.push_back(execute);
+
+        // 'comm-pid', with the comm possibly padded on the left.
+        auto task_id = boost::trim_copy(line.substr(0, bracket));
+        auto dash = task_id.rfind('-');
+        if (dash != std::string::npos &&
+            boost::starts_with(task_id, "mount")) {
+            auto pid = std::atoi(task_id.c_str() + dash + 1);
+            mounts_[pid][proc] += execute;
+        }
+    }
+
+    const Context& ctx_;
+    fs::path instance_;
+    int pipe_ = -1;
+    std::thread thread_;
+    std::atomic<bool> stop_{false};     // Tells the reader to finish.
+    std::atomic<bool> stopped_{false};  // Stop() has run.
+    launch_clock::time_point start_{};
+    launch_clock::time_point end_{};
+    static inline std::mutex live_mutex_;
+    static inline std::set<RpcTracepoints*> live_;
+    // Only touched by the reader until it's joined.
+    size_t events_ = 0;
+    uint64_t overruns_ = 0;
+    std::map<std::string, Procedure> procs_;
+    std::map<int, std::map<std::string, uint64_t>> mounts_;
+    std::map<std::string, size_t> errors_;
+};  // class RpcTracepoints
+
+/**
+ * Parse a comma-separated list of integers, e.g. "0,1000,5000".
+ */
+static std::vector<int> parse_int_list(const std::string& list) {
+    auto items = std::vector<std::string>{};
+    auto values = std::vector<int>{};
+    boost::split(items, list, boost::is_any_of(","));
+    for (const auto& item : items) {
+        auto trimmed = boost::trim_copy(item);
+        if (trimmed.empty()) {
+            continue;
+        }
+        try {
+            values.push_back(std::stoi(trimmed));
+        } catch (std::exception&) {
+            EFMT("Invalid number '{}' in list '{}'", trimmed, list);
+        }
+    }
+    return values;
+}
+
+/**
+ * One export: a path, exported to one client specification with the given
+ * options.
+ */
+struct ExportEntry {
+    std::string path;
+    std::string client;
+    std::string options;
+
+    //! The entry as a line in an exports(5) file.
+    std::string Line() const {
+        return fmt::format("{} {}({})", path, client, options);
+    }
+    //! The entry as an exportfs(8) `client:/path` argument.
+    std::string Spec() const { return client + ":" + path; }
+};
+
+/**
+ * (Re)write our exports file with @p entries between the paramount markers.
+ */
+static void write_exports(const fs::path& exports,
+                          const std::vector<ExportEntry>& entries) {
+    auto ef = std::ofstream{};
+    ef.exceptions(std::ofstream::failbit);
+    ef.open(exports, std::ios_base::trunc);
+    ef << "### BEGIN paramount\n";
+    for (const auto& entry : entries) {
+        ef << entry.Line() << "\n";
+    }
+    ef << "### END paramount\n";
+    ef.close();
+}
+
+static bool exportfs(const Context& ctx) {
+    auto efs = bp::search_path("exportfs");
+    std::error_code ec;
+    VERBOSE(ctx, "run exportfs");
+    auto span = TraceSpan("exportfs -ra", "exportfs");
+    bp::system(efs.native() + " -ra", ec);
+    if (ec.value() != 0) {
+        EFMT_SYS(ec.value(), "exportfs failed");
+    }
+    return true;
+}
+
+/**
+ * Add a single export with `exportfs -o`, leaving every other export on the
+ * host alone. On a worker thread, pass @p errors to have a failure recorded
+ * there rather than exiting; the return value says whether it succeeded.
+ */
+static bool exportfs_add(const Context& ctx,
+                         const ExportEntry& entry,
+                         FirstError* errors = nullptr) {
+    auto efs = bp::search_path("exportfs");
+    VERBOSE(ctx, "exportfs add {}", entry.Spec());
+    auto span = TraceSpan("exportfs -o " + entry.Spec(), "exportfs");
+    auto r = run_process({efs.native(), "-o", entry.options, entry.Spec()});
+    if (!r.Success()) {
+        auto msg = fmt::format(FMT_STRING("exportfs -o {} {} failed (exit {})"),
+                               entry.options, entry.Spec(), r.exit_code);
+        if (!errors) {
+            error(msg);
+        }
+        errors->Set(std::move(msg));
+    }
+    return r.Success();
+}
+
+/**
+ * Remove a single export with `exportfs -u`. Failure is only reported, as
+ * this runs during cleanup.
+ */
+static void exportfs_remove(const Context& ctx, const ExportEntry& entry) {
+    auto efs = bp::search_path("exportfs");
+    VERBOSE(ctx, "exportfs remove {}", entry.Spec());
+    auto span = TraceSpan("exportfs -u " + entry.Spec(), "exportfs");
+    auto r = run_process({efs.native(), "-u", entry.Spec()});
+    if (!r.Success()) {
+        std::cerr << fmt::format(
+            FMT_STRING("exportfs -u {} failed (exit {})\n"), entry.Spec(),
+            r.exit_code);
+    }
+}
+
+/**
+ * Generate @p n unrelated export entries of the given variant:
+ *
+ * - "per-dir": n filler directories, each exported to everyone.
+ * - "per-client": one filler directory exported to n distinct client IPs.
+ * - "wildcard": n filler directories, each exported to a distinct wildcard
+ *   hostname pattern, which mountd must match against client names.
+ *
+ * Filler directories are created under @p fillerdir as needed. Each export
+ * gets its own fsid, as the temporary directory may be on a filesystem
+ * without a UUID. @p fsid_group keeps different sets of filler exports'
+ * fsids apart.
+ */
+static std::vector<ExportEntry> filler_exports(const std::string& variant,
+                                               int n,
+                                               const fs::path& fillerdir,
+                                               int fsid_group = 1) {
+    auto entries = std::vector<ExportEntry>{};
+    auto fsid = [fsid_group](int i) {
+        return fmt::format(FMT_STRING("00000000-0000-0000-{:04x}-{:012x}"),
+                           fsid_group, i + 1);
+    };
+    auto dir = [&fillerdir](int i) {
+        auto path = fillerdir / fmt::format(FMT_STRING("f{:06}"), i);
+        fs::create_directories(path);
+        return path.native();
+    };
+    for (int i = 0; i < n; i++) {
+        if (variant == "per-client") {
+            entries.push_back(
+                {dir(0),
+                 fmt::format(FMT_STRING("10.{}.{}.{}"), (i >> 16) & 0xff,
+                             (i >> 8) & 0xff, i & 0xff),
+                 "ro,no_subtree_check,fsid=" + fsid(0)});
+        } else if (variant == "wildcard") {
+            entries.push_back(
+                {dir(i), fmt::format(FMT_STRING("*.h{:06}.invalid"), i),
+                 "ro,no_subtree_check,fsid=" + fsid(i)});
+        } else {
+            entries.push_back(
+                {dir(i), "*", "ro,no_subtree_check,fsid=" + fsid(i)});
+        }
     }
+    return entries;
 }
-#define VERBOSE(ctx, msg, ...) \
-    verbose(ctx, fmt::format(FMT_STRING(msg), ##__VA_ARGS__))
 
-[[noreturn]] [[maybe_unused]] static void error(const std::string& msg) {
-    std::cerr << fmt::format("{}\n", msg);
-    exit(1);
+/**
+ * Reconfigure exports continuously in the background, to see how export
+ * cache flushes and mountd contention affect concurrent mounts.
+ *
+ * Each of ctx.churn_threads threads loops until Stop(), either adding and
+ * removing an unrelated export of its own ("add-remove"), or running
+ * `exportfs -ra` ("reexport").
+ */
+class ExportChurn {
+   public:
+    ExportChurn(const Context& ctx, const fs::path& churndir) : ctx_(ctx) {
+        auto entries =
+            filler_exports("per-dir", ctx.churn_threads, churndir, 2);
+        start_ = launch_clock::now();
+        for (int t = 0; t < ctx.churn_threads; t++) {
+            threads_.emplace_back(
+                [this, entry = entries[t]]() { Churn(entry); });
+        }
+    }
+    ~ExportChurn() { Stop(); }
+
+    void Stop() {
+        if (stop_.exchange(true)) {
+            return;
+        }
+        for (auto& t : threads_) {
+            t.join();
+        }
+        end_ = launch_clock::now();
+    }
+
+    //! Report churn operation latency and failures. Call after Stop().
+    void Report(const std::string& tag) {
+        report_latency(
+            fmt::format(FMT_STRING("churn{}[{}]"), tag, ctx_.export_churn),
+            elapsed_, end_ - start_);
+        std::cout << fmt::format(
+            FMT_STRING("churn{} failures: {}/{}\n"), tag, failures_,
+            elapsed_.size());
+    }
+
+   private:
+    void Churn(const ExportEntry& entry) {
+        auto efs = bp::search_path("exportfs").native();
+        auto ops = std::vector<std::vector<std::string>>{};
+        if (ctx_.export_churn == "reexport") {
+            ops.push_back({efs, "-ra"});
+        } else {
+            ops.push_back({efs, "-o", entry.options, entry.Spec()});
+            ops.push_back({efs, "-u", entry.Spec()});
+        }
+        for (size_t i = 0; !stop_; i = (i + 1) % ops.size()) {
+            auto r = run_process(ops[i]);
+            if (tracer) {
+                tracer->Span("churn " + boost::algorithm::join(ops[i], " "),
+                             "exportfs", Tracer::pid_threads, gettid(),
+                             r.start, r.end);
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            elapsed_.push_back(r.Elapsed());
+            failures_ += !r.Success();
+        }
+        // Don't leave our export behind.
+        if (ctx_.export_churn == "add-remove") {
+            run_process(ops[1]);
+        }
+    }
+
+    const Context& ctx_;
+    std::atomic<bool> stop_ = false;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::vector<launch_clock::duration> elapsed_;
+    int failures_ = 0;
+    launch_clock::time_point start_{};
+    launch_clock::time_point end_{};
+};  // class ExportChurn
+
+/**
+ * Run and report a mount wave, with export churn in the background if
+ * configured.
+ */
+static WaveResult mount_wave(const Context& ctx,
+                             const Workload& wl,
+                             const std::string& tag) {
+    auto rpc = rpc_snapshot(ctx);
+    auto perf = perf_snapshot();
+    auto churn = std::optional<ExportChurn>{};
+    if (ctx.export_churn != "none") {
+        churn.emplace(ctx, wl.churndir);
+    }
+    auto rpc_trace = std::optional<RpcTracepoints>{};
+    if (ctx.rpc_trace) {
+        rpc_trace.emplace(ctx);
+    }
+    auto wave = WaveResult{};
+    {
+        auto span = TraceSpan("mount" + tag, "phase");
+        wave = run_wave(ctx, wl.mount_argvs);
+    }
+    if (rpc_trace) {
+        rpc_trace->Stop();
+    }
+    if (churn) {
+        churn->Stop();
+        churn->Report(tag);
+    }
+    report_wave(ctx, "mount" + tag, wave);
+    report_export_cache(tag);
+    report_rpc_delta("mount" + tag, rpc);
+    report_perf_delta("mount" + tag, perf);
+    if (rpc_trace) {
+        rpc_trace->Report(tag);
+    }
+    return wave;
 }
-[[noreturn]] static void error_sys(int syserr, const std::string& msg) {
-    std::cerr << fmt::format("{}: {}\n", msg, strerror(syserr));
-    exit(1);
+
+/**
+ * A named setup step applied to one directory, for pipelined_wave().
+ */
+struct PipelineStage {
+    std::string name;
+    std::function<void(int)> fn;
+};
+
+/**
+ * Set up and mount each directory in a pipeline rather than in sequential
+ * phases. Directory indices flow through @p stages in order, each with
+ * ctx.setup_threads workers and a queue of at most ctx.pipeline_depth
+ * directories feeding it, and each directory's mount is launched as soon as
+ * it leaves the last stage. Time to all mounted then tends towards the
+ * slowest stage rather than the sum of them.
+ *
+ * The wave's start is the start of setup, so its wall time is the time to
+ * all mounted. Stages record failures in @p errors; the pipeline then stops
+ * taking on directories and reports the error once its workers are joined.
+ */
+static WaveResult pipelined_wave(const Context& ctx,
+                                 const Workload& wl,
+                                 const std::vector<PipelineStage>& stages,
+                                 FirstError& errors) {
+    int n = static_cast<int>(wl.mount_argvs.size());
+    auto nstages = stages.size();
+    auto rpc = rpc_snapshot(ctx);
+    auto perf = perf_snapshot();
+    auto churn = std::optional<ExportChurn>{};
+    if (ctx.export_churn != "none") {
+        churn.emplace(ctx, wl.churndir);
+    }
+    auto watchdog = HangWatchdog(ctx.hang_threshold);
+    auto rpc_trace = std::optional<RpcTracepoints>{};
+    if (ctx.rpc_trace) {
+        rpc_trace.emplace(ctx);
+    }
+    auto launcher = std::optional<Launcher>{};
+    if (ctx.launcher == "epoll") {
+        launcher.emplace(launcher_warn(ctx));
+    }
+
+    // queues[s] feeds stage s; queues[nstages] feeds the mounter.
+    auto queues = std::vector<std::unique_ptr<BoundedQueue<int>>>{};
+    for (size_t s = 0; s <= nstages; s++) {
+        queues.push_back(
+            std::make_unique<BoundedQueue<int>>(ctx.pipeline_depth));
+    }
+    auto elapsed =
+        std::vector<std::vector<launch_clock::duration>>(nstages);
+    auto elapsed_mutex = std::mutex{};
+    auto stage_end = std::vector<launch_clock::time_point>(nstages);
+
+    auto wave = WaveResult{};
+    wave.start = launch_clock::now();
+    auto feeder = std::thread([&]() {
+        for (int d = 0; d < n; d++) {
+            queues[0]->Push(d);
+        }
+        queues[0]->Close();
+    });
+    auto pool = std::vector<std::thread>{};
+    auto running = std::vector<std::atomic<int>>(nstages);
+    auto workers = std::max(1, std::min(ctx.setup_threads, n));
+    for (size_t s = 0; s < nstages; s++) {
+        running[s] = workers;
+        for (int w = 0; w < workers; w++) {
+            pool.emplace_back([&, s]() {
+                while (auto d = queues[s]->Pop()) {
+                    // After a failure, just drain the queue.
+                    if (errors.Failed()) {
+                        continue;
+                    }
+                    auto start = launch_clock::now();
+                    stages[s].fn(*d);
+                    if (errors.Failed()) {
+                        continue;
+                    }
+                    auto end = launch_clock::now();
+                    auto e = end - start;
+                    if (tracer) {
+                        tracer->Span(
+                            stages[s].name, "pipeline", Tracer::pid_threads,
+                            gettid(), start, end,
+                            fmt::format(FMT_STRING("{{\"index\":{}}}"), *d));
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(elapsed_mutex);
+                        elapsed[s].push_back(e);
+                    }
+                    queues[s + 1]->Push(*d);
+                }
+                // The last worker out closes the next stage's input.
+                if (--running[s] == 0) {
+                    stage_end[s] = launch_clock::now();
+                    queues[s + 1]->Close();
+                }
+            });
+        }
+    }
+
+    auto mounters = std::vector<std::future<MountOutcome>>(n);
+    while (auto d = queues[nstages]->Pop()) {
+        if (errors.Failed()) {
+            continue;
+        }
+        VERBOSE(ctx, "Launch pipelined mounter {}", *d);
+        if (launcher) {
+            mounters[*d] =
+                launch_with_retry(ctx, *launcher, wl.mount_argvs[*d]);
+        } else {
+            mounters[*d] =
+                std::async(std::launch::async,
+                           [&ctx, argv = wl.mount_argvs[*d]]() {
+                               return run_with_retry(ctx, argv);
+                           });
+        }
+    }
+    feeder.join();
+    for (auto& t : pool) {
+        t.join();
+    }
+    errors.Check();
+
+    wave.end = wave.start;
+    for (auto& future : mounters) {
+        auto outcome = future.get();
+        wave.failures += !outcome.result.Success();
+        wave.end = std::max(wave.end, outcome.result.end);
+        wave.outcomes.push_back(std::move(outcome));
+    }
+    launcher.reset();
+    if (rpc_trace) {
+        rpc_trace->Stop();
+    }
+
+    for (size_t s = 0; s < nstages; s++) {
+        report_latency("pipeline " + stages[s].name, elapsed[s],
+                       stage_end[s] - wave.start);
+    }
+    if (churn) {
+        churn->Stop();
+        churn->Report("[pipeline]");
+    }
+    report_wave(ctx, "mount[pipeline]", wave);
+    report_export_cache("[pipeline]");
+    report_rpc_delta("mount[pipeline]", rpc);
+    report_perf_delta("mount[pipeline]", perf);
+    if (rpc_trace) {
+        rpc_trace->Report("[pipeline]");
+    }
+    return wave;
 }
 
-#define EFMT(msg, ...) error(fmt::format(FMT_STRING(msg), ##__VA_ARGS__))
-#define EFMT_SYS(err, msg, ...) \
-    error_sys(err, fmt::format(FMT_STRING(msg), ##__VA_ARGS__))
+/**
+ * One measured cycle: mount everything, verify via /proc/self/mounts, then
+ * unmount everything. Output lines are labelled with @p tag.
+ *
+ * @return The mount wave's results.
+ */
+static WaveResult mount_cycle(const Context& ctx,
+                              const Workload& wl,
+                              const std::string& tag) {
+    auto kmem = std::optional<KernelMemory>{};
+    if (ctx.kmem) {
+        kmem = read_kernel_memory();
+    }
+    auto wave = mount_wave(ctx, wl, tag);
 
-using clean_function = std::function<void()>;
+    auto vstart = launch_clock::now();
+    auto nmounts =
+        verify_mounts(ctx, wl.m_to_c, ctx.threads - wave.failures);
+    std::cout << fmt::format(
+        FMT_STRING("verify{} (ms): {:.2f} for {} mounts\n"), tag,
+        to_ms(launch_clock::now() - vstart), nmounts);
+    if (ctx.mountstats) {
+        report_mountstats(tag, wl.clientdir);
+    }
+    if (kmem) {
+        report_kernel_memory("mount" + tag, *kmem, read_kernel_memory(),
+                             nmounts);
+    }
 
-static std::optional<clean_function> cleanup;
+    auto rpc = rpc_snapshot(ctx);
+    auto perf = perf_snapshot();
+    auto umount = WaveResult{};
+    {
+        auto span = TraceSpan("umount" + tag, "phase");
+        umount = run_wave(ctx, wl.umount_argvs);
+    }
+    report_wave(ctx, "umount" + tag, umount);
+    report_rpc_delta("umount" + tag, rpc);
+    report_perf_delta("umount" + tag, perf);
+    return wave;
+}
 
-static void sig_handler(int sig,
-                        siginfo_t* info,
-                        [[maybe_unused]] void* uctx) {
-    if (cleanup) {
-        (*cleanup)();
-        cleanup.reset();
+/**
+ * Fork a process that moves into its own mount namespace and then waits to
+ * be killed. Its copy of the mount at @p at is left as a peer of ours if
+ * @p mode is "shared", made a slave of it for "slave", and is private
+ * anyway for "private".
+ *
+ * The child only makes async-signal-safe calls, so forking from a
+ * multithreaded process is fine. It's killed when we exit, too, so that an
+ * error can't leave it behind holding copies of our mounts. That's tied to
+ * the calling thread, which should be the main one.
+ *
+ * @return The child's pid.
+ */
+static pid_t spawn_peer_namespace(const fs::path& at,
+                                  const std::string& mode) {
+    int ready[2];
+    if (pipe(ready) < 0) {
+        EFMT_SYS(errno, "Failed to create pipe");
+    }
+    auto parent = getpid();
+    auto pid = fork();
+    if (pid < 0) {
+        EFMT_SYS(errno, "Failed to fork peer namespace");
+    }
+    if (pid == 0) {
+        close(ready[0]);
+        // We may already have gone before the death signal was armed.
+        if (prctl(PR_SET_PDEATHSIG, SIGKILL) < 0 || getppid() != parent) {
+            _exit(1);
+        }
+        if (unshare(CLONE_NEWNS) < 0) {
+            _exit(1);
+        }
+        if (mode == "slave" &&
+            mount("none", at.c_str(), nullptr, MS_REC | MS_SLAVE, nullptr) <
+                0) {
+            _exit(1);
+        }
+        char c = 'r';
+        if (write(ready[1], &c, 1) != 1) {
+            _exit(1);
+        }
+        for (;;) {
+            pause();
+        }
     }
+    close(ready[1]);
+    char c;
+    if (read(ready[0], &c, 1) != 1) {
+        EFMT("Peer namespace {} failed to start", pid);
+    }
+    close(ready[0]);
+    return pid;
 }
 
-static bool exportfs(const Context& ctx) {
-    auto efs = bp::search_path("exportfs");
+/**
+ * Run the mount wave (then an unmount wave) with the client root as a mount
+ * of each propagation type in turn, with ctx.peers other namespaces holding
+ * a copy of it. With shared propagation every mount is replicated to each
+ * peer; with slave propagation it's replicated one way; with private
+ * propagation it isn't replicated at all.
+ */
+static void propagation_experiment(const Context& ctx,
+                                   const Workload& wl) {
+    const auto& clientdir = wl.clientdir;
+    // Make the client root a mount point, so it has a propagation type of
+    // its own.
+    if (mount(clientdir.c_str(), clientdir.c_str(), nullptr, MS_BIND,
+              nullptr) < 0) {
+        EFMT_SYS(errno, "Failed to bind mount {} on itself",
+                 clientdir.native());
+    }
+
+    for (const auto& mode : {"shared", "slave", "private"}) {
+        if (!cleanup) {
+            break;  // Interrupted.
+        }
+        auto flags = std::string(mode) == "private" ? MS_PRIVATE : MS_SHARED;
+        if (mount("none", clientdir.c_str(), nullptr, MS_REC | flags,
+                  nullptr) < 0) {
+            EFMT_SYS(errno, "Failed to set {} propagation on {}", mode,
+                     clientdir.native());
+        }
+        auto peers = std::vector<pid_t>{};
+        for (int p = 0; p < ctx.peers; p++) {
+            peers.push_back(spawn_peer_namespace(clientdir, mode));
+        }
+        VERBOSE(ctx, "{} propagation with {} peer namespaces", mode,
+                peers.size());
+
+        auto tag = fmt::format(FMT_STRING("[{},peers={}]"), mode, ctx.peers);
+        mount_cycle(ctx, wl, tag);
+
+        for (auto pid : peers) {
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+        }
+    }
+
+    if (umount2(clientdir.c_str(), MNT_DETACH) < 0) {
+        VERBOSE(ctx, "Failed to unmount {}: {}", clientdir.native(),
+                strerror(errno));
+    }
+}
+
+/**
+ * Grow the mount table by ctx.background_mounts[i] unrelated mounts in
+ * turn, running a mount cycle at each size. The dummy mounts are tmpfs
+ * instances or bind mounts of a single directory, made directly with
+ * mount(2) so that populating a large table is quick.
+ */
+static void background_experiment(const Context& ctx,
+                                  const Workload& wl,
+                                  const fs::path& bgdir) {
     std::error_code ec;
-    VERBOSE(ctx, "run exportfs");
-    bp::system(efs.native() + " -ra", ec);
-    if (ec.value() != 0) {
-        EFMT_SYS(ec.value(), "exportfs failed");
+    if (!fs::create_directory(bgdir, ec)) {
+        EFMT_SYS(ec.value(), "Failed to create background root {}",
+                 bgdir.native());
     }
-    return true;
+    auto source = bgdir / "source";
+    fs::create_directory(source);
+
+    auto sizes = ctx.background_mounts;
+    std::sort(sizes.begin(), sizes.end());
+    auto mounted = std::vector<fs::path>{};
+    for (auto size : sizes) {
+        if (!cleanup) {
+            break;  // Interrupted.
+        }
+        auto pstart = launch_clock::now();
+        while (mounted.size() < static_cast<size_t>(size)) {
+            auto target =
+                bgdir / fmt::format(FMT_STRING("b{:06}"), mounted.size());
+            fs::create_directory(target);
+            int r = ctx.background_type == "bind"
+                        ? mount(source.c_str(), target.c_str(), nullptr,
+                                MS_BIND, nullptr)
+                        : mount("paramount", target.c_str(), "tmpfs", 0,
+                                "size=64k");
+            if (r < 0) {
+                EFMT_SYS(errno, "Failed to mount background {}",
+                         target.native());
+            }
+            mounted.push_back(target);
+        }
+        VERBOSE(ctx, "{} background {} mounts in {:.2f}ms", mounted.size(),
+                ctx.background_type, to_ms(launch_clock::now() - pstart));
+
+        mount_cycle(ctx, wl,
+                    fmt::format(FMT_STRING("[background={}]"), size));
+    }
+
+    for (auto it = mounted.rbegin(); it != mounted.rend(); ++it) {
+        if (umount2(it->c_str(), MNT_DETACH) < 0) {
+            VERBOSE(ctx, "Failed to unmount {}: {}", it->native(),
+                    strerror(errno));
+        }
+    }
+}
+
+/**
+ * Grow the export table by ctx.export_sweep[i] unrelated entries in turn,
+ * timing `exportfs -ra` at each size before running a mount cycle.
+ */
+static void export_table_experiment(const Context& ctx,
+                                    const Workload& wl,
+                                    const fs::path& exports,
+                                    const std::vector<ExportEntry>& base,
+                                    const fs::path& fillerdir) {
+    for (auto size : ctx.export_sweep) {
+        if (!cleanup) {
+            break;  // Interrupted.
+        }
+        auto entries = base;
+        auto filler = filler_exports(ctx.export_variant, size, fillerdir);
+        entries.insert(entries.end(), filler.begin(), filler.end());
+        write_exports(exports, entries);
+
+        auto tag = fmt::format(FMT_STRING("[exports={},{}]"), size,
+                               ctx.export_variant);
+        auto start = launch_clock::now();
+        exportfs(ctx);
+        std::cout << fmt::format(FMT_STRING("exportfs{} (ms): {:.2f}\n"), tag,
+                                 to_ms(launch_clock::now() - start));
+
+        mount_cycle(ctx, wl, tag);
+    }
+}
+
+static constexpr const char* nfsd_threads_file = "/proc/fs/nfsd/threads";
+
+/**
+ * Set nfsd's thread count to each of ctx.nfsd_threads_sweep in turn,
+ * running a mount cycle and reporting mount throughput at each. Cleanup
+ * puts the original count back, however the run ends.
+ */
+static void nfsd_threads_experiment(const Context& ctx, const Workload& wl) {
+    auto threads_file = fs::path(nfsd_threads_file);
+    auto set_threads = [&threads_file](const std::string& n) {
+        auto tf = std::ofstream{};
+        tf.exceptions(std::ofstream::failbit);
+        tf.open(threads_file);
+        tf << n << "\n";
+        tf.close();
+    };
+    for (auto n : ctx.nfsd_threads_sweep) {
+        if (!cleanup) {
+            break;  // Interrupted.
+        }
+        set_threads(std::to_string(n));
+        auto tag = fmt::format(FMT_STRING("[nfsd-threads={}]"), n);
+        auto wave = mount_cycle(ctx, wl, tag);
+        auto secs = std::chrono::duration<double>(wave.end - wave.start);
+        auto mounted = wave.outcomes.size() - wave.failures;
+        std::cout << fmt::format(
+            FMT_STRING("throughput{} (mounts/s): {:.1f}\n"), tag,
+            secs.count() > 0 ? mounted / secs.count() : 0.0);
+    }
+}
+
+/**
+ * The options that determine a fixture's layout and exports, keyed by
+ * option name. A --fixture reuse or destroy run has to share these with the
+ * run that created the fixture.
+ */
+static std::map<std::string, std::string> fixture_shape(const Context& ctx) {
+    return {{"export-mode", ctx.export_mode},
+            {"export-update", ctx.export_update},
+            {"layout", ctx.layout},
+            {"shard-size", std::to_string(ctx.shard_size)},
+            {"threads", std::to_string(ctx.threads)}};
+}
+
+/**
+ * Record the fixture's shape in @p path, as 'option=value' lines.
+ */
+static void write_fixture_manifest(const Context& ctx, const fs::path& path) {
+    auto mf = std::ofstream{};
+    mf.exceptions(std::ofstream::failbit);
+    mf.open(path, std::ios_base::trunc);
+    for (const auto& [key, value] : fixture_shape(ctx)) {
+        mf << key << "=" << value << "\n";
+    }
+    mf.close();
+}
+
+/**
+ * Take the fixture's shape from its manifest at @p path. Options given
+ * explicitly on the command line must agree with it.
+ */
+static void load_fixture_manifest(Context& ctx,
+                                  const po::variables_map& vm,
+                                  const fs::path& path) {
+    auto mf = std::ifstream(path);
+    if (!mf) {
+        EFMT("No fixture manifest {}, use --fixture create first",
+             path.native());
+    }
+    auto shape = std::map<std::string, std::string>{};
+    for (std::string line; std::getline(mf, line);) {
+        auto eq = line.find('=');
+        if (eq != std::string::npos) {
+            shape[line.substr(0, eq)] = line.substr(eq + 1);
+        }
+    }
+    for (const auto& [key, value] : fixture_shape(ctx)) {
+        auto srch = shape.find(key);
+        if (srch == shape.end()) {
+            EFMT("Fixture manifest {} has no '{}'", path.native(), key);
+        }
+        if (srch->second != value && !vm[key].defaulted()) {
+            EFMT("--{} {} doesn't match the fixture's {}", key, value,
+                 srch->second);
+        }
+    }
+    ctx.export_mode = shape["export-mode"];
+    ctx.export_update = shape["export-update"];
+    ctx.layout = shape["layout"];
+    ctx.shard_size = std::stoi(shape["shard-size"]);
+    ctx.threads = std::stoi(shape["threads"]);
 }
 
 int main(int argc, char* argv[]) {
@@ -84,10 +2907,136 @@ int main(int argc, char* argv[]) {
     auto desc = po::options_description("Allowed options");
     desc.add_options()                      //
         ("help,h", "produce help message")  //
+        ("background-mounts", po::value<std::string>(),
+         "comma-separated list of background mount table sizes; run the "
+         "mount wave with this many unrelated mounts present")  //
+        ("background-type",
+         po::value<std::string>(&ctx.background_type)->default_value("tmpfs"),
+         "background mount type: 'tmpfs' or 'bind'")  //
+        ("backoff", po::value<int>(&ctx.backoff_ms)->default_value(100),
+         "initial retry backoff in milliseconds, doubled for each retry")  //
+        ("backoff-max",
+         po::value<int>(&ctx.backoff_max_ms)->default_value(10000),
+         "maximum retry backoff in milliseconds")  //
+        ("cgroup", po::value<std::string>(&ctx.cgroup),
+         "run the mount workload in a new cgroup v2 child of this name, "
+         "and report its accounting afterwards")  //
+        ("cgroup-parent",
+         po::value<std::string>(&ctx.cgroup_parent)
+             ->default_value("/sys/fs/cgroup"),
+         "the cgroup to create the --cgroup child in")  //
+        ("churn-threads",
+         po::value<int>(&ctx.churn_threads)->default_value(1),
+         "the number of concurrent export churn loops")  //
+        ("cpu-quota", po::value<double>(&ctx.cpu_quota)->default_value(0),
+         "with --cgroup, limit the workload to this many CPUs")  //
+        ("export-churn",
+         po::value<std::string>(&ctx.export_churn)->default_value("none"),
+         "reconfigure exports during the mount wave: 'none', 'add-remove' "
+         "(add and remove unrelated exports) or 'reexport' (run "
+         "'exportfs -ra')")  //
+        ("export-mode",
+         po::value<std::string>(&ctx.export_mode)->default_value("pseudo"),
+         "'pseudo' to export one NFSv4 pseudo-root, or 'per-dir' to export "
+         "each directory with its own fsid")  //
+        ("export-sweep", po::value<std::string>(),
+         "comma-separated list of export table sizes; add this many "
+         "unrelated exports and time exportfs and the mount wave")  //
+        ("export-update",
+         po::value<std::string>(&ctx.export_update)->default_value("full"),
+         "'full' to write an exports file and run 'exportfs -ra', or "
+         "'incremental' to add and remove only our entries with "
+         "'exportfs -o' and 'exportfs -u'")  //
+        ("export-variant",
+         po::value<std::string>(&ctx.export_variant)
+             ->default_value("per-dir"),
+         "unrelated export type for --export-sweep: 'per-dir', "
+         "'per-client' or 'wildcard'")  //
+        ("fixture",
+         po::value<std::string>(&ctx.fixture)->default_value("none"),
+         "'none' to build and remove the fixture on every run, 'create' to "
+         "build a persistent one in --fixture-dir and exit, 'reuse' to run "
+         "the mount workload against it, or 'destroy' to remove it")  //
+        ("fixture-dir",
+         po::value<std::string>(&ctx.fixture_dir)
+             ->default_value(
+                 (fs::temp_directory_path() / "paramount.fixture").native()),
+         "the directory for a persistent fixture")  //
+        ("hang-threshold",
+         po::value<double>(&ctx.hang_threshold)->default_value(30),
+         "report helpers running longer than this many seconds (0 to "
+         "disable)")  //
+        ("io-max", po::value<std::string>(&ctx.io_max),
+         "with --cgroup, an io.max limit, e.g. '8:0 wiops=1000'")  //
+        ("kmem", po::bool_switch(),
+         "report kernel slab memory used per mount in each mount wave, and "
+         "any left unreclaimed after cleanup")  //
+        ("launcher,l",
+         po::value<std::string>(&ctx.launcher)->default_value("thread"),
+         "how to run mount helpers: 'thread' (one blocking thread per "
+         "mount) or 'epoll' (one reaper thread using pidfds)")  //
+        ("layout",
+         po::value<std::string>(&ctx.layout)->default_value("flat"),
+         "directory layout: 'flat' (mount/d0123) or 'sharded' "
+         "(mount/s00/d000123), for very large mount counts")  //
+        ("memory-max", po::value<std::string>(&ctx.memory_max),
+         "with --cgroup, a memory.max limit in bytes, e.g. '2G'")  //
+        ("mountstats", po::bool_switch(),
+         "after mounting, report RPC and transport statistics for the "
+         "client mounts from /proc/self/mountstats")  //
+        ("nfsd-threads-sweep", po::value<std::string>(),
+         "comma-separated list of nfsd thread counts; set "
+         "/proc/fs/nfsd/threads to each and run the mount wave")  //
+        ("peers", po::value<int>(&ctx.peers)->default_value(0),
+         "with --propagation-sweep, the number of extra mount namespaces "
+         "holding a copy of the client mounts")  //
+        ("perf", po::bool_switch(),
+         "count CPU cycles, task clock, context switches and page faults "
+         "for each phase with perf_event_open, and report the tool's own "
+         "share")  //
+        ("pipeline", po::bool_switch(),
+         "pipeline the setup: mount each directory as soon as it has been "
+         "created, bind mounted and exported, rather than after all of "
+         "them")  //
+        ("pipeline-depth",
+         po::value<int>(&ctx.pipeline_depth)->default_value(64),
+         "with --pipeline, the most directories queued for each stage")  //
         ("preserve,p", po::bool_switch(),
          "preserve temporary files and directories")  //
+        ("private-ns", po::bool_switch(),
+         "run in a private mount namespace; mounts don't propagate to the "
+         "host")  //
+        ("propagation-sweep", po::bool_switch(),
+         "run the mount wave under shared, slave and private propagation "
+         "and compare")  //
+        ("retries,r", po::value<int>(&ctx.retries)->default_value(0),
+         "the number of times to retry a failed mount")  //
+        ("rpc-stats", po::bool_switch(),
+         "report client and server RPC counter changes over each phase, "
+         "from /proc/net/rpc and the nfsd thread pool stats")  //
+        ("rpc-trace", po::bool_switch(),
+         "trace the client's sunrpc and nfs4 tracepoints over each mount "
+         "wave, and break mount latency down by RPC (EXCHANGE_ID, "
+         "CREATE_SESSION, LOOKUP_ROOT, GETATTR, ...)")  //
+        ("sample-interval",
+         po::value<double>(&ctx.sample_interval)->default_value(0),
+         "sample pressure stall information and our cgroup's CPU and "
+         "memory stats every this many seconds (0 to disable)")  //
+        ("setup-threads",
+         po::value<int>(&ctx.setup_threads)
+             ->default_value(std::thread::hardware_concurrency()),
+         "the number of threads used to build and remove the test "
+         "fixture")  //
+        ("shard-size", po::value<int>(&ctx.shard_size)->default_value(1000),
+         "the number of directories per shard with --layout sharded")  //
         ("threads,t", po::value<int>(&ctx.threads)->default_value(4),
          "the number of concurrent commands to issue")  //
+        ("timeout", po::value<double>(&ctx.timeout)->default_value(120),
+         "kill a mount helper after this many seconds (0 for no "
+         "timeout)")  //
+        ("trace", po::value<std::string>(&ctx.trace),
+         "write a Chrome trace-event JSON timeline of phases, mounts, "
+         "exportfs calls and verification scans to this file")  //
         ("verbose,v", po::bool_switch(),
          "show verbose output")  //
         ;
@@ -100,36 +3049,274 @@ int main(int argc, char* argv[]) {
         std::cout << desc << "\n";
         return EXIT_FAILURE;
     }
+    if (ctx.fixture != "none" && ctx.fixture != "create" &&
+        ctx.fixture != "reuse" && ctx.fixture != "destroy") {
+        EFMT("Unknown fixture mode '{}'", ctx.fixture);
+    }
+    auto manifest = fs::path(ctx.fixture_dir) / "fixture";
+    if (ctx.fixture == "create" && fs::exists(manifest)) {
+        EFMT("Fixture {} already exists, use --fixture destroy first",
+             ctx.fixture_dir);
+    }
+    if (ctx.fixture == "reuse" || ctx.fixture == "destroy") {
+        load_fixture_manifest(ctx, vm, manifest);
+    }
+    if (ctx.cgroup.empty() &&
+        (ctx.cpu_quota > 0 || !ctx.memory_max.empty() ||
+         !ctx.io_max.empty())) {
+        EFMT("--cpu-quota, --memory-max and --io-max need --cgroup");
+    }
+    if (ctx.launcher != "thread" && ctx.launcher != "epoll") {
+        EFMT("Unknown launcher '{}'", ctx.launcher);
+    }
+    if (ctx.layout != "flat" && ctx.layout != "sharded") {
+        EFMT("Unknown layout '{}'", ctx.layout);
+    }
+    if (ctx.shard_size < 1) {
+        EFMT("--shard-size must be at least 1");
+    }
+    if (vm.count("background-mounts")) {
+        ctx.background_mounts =
+            parse_int_list(vm["background-mounts"].as<std::string>());
+    }
+    if (ctx.export_mode != "pseudo" && ctx.export_mode != "per-dir") {
+        EFMT("Unknown export mode '{}'", ctx.export_mode);
+    }
+    if (ctx.export_update != "full" && ctx.export_update != "incremental") {
+        EFMT("Unknown export update mode '{}'", ctx.export_update);
+    }
+    if (ctx.export_churn != "none" && ctx.export_churn != "add-remove" &&
+        ctx.export_churn != "reexport") {
+        EFMT("Unknown export churn mode '{}'", ctx.export_churn);
+    }
+    if (ctx.export_churn == "reexport" &&
+        ctx.export_update == "incremental") {
+        // 'exportfs -ra' would drop our own entries.
+        EFMT("--export-churn reexport needs --export-update full");
+    }
+    if (vm.count("nfsd-threads-sweep")) {
+        ctx.nfsd_threads_sweep =
+            parse_int_list(vm["nfsd-threads-sweep"].as<std::string>());
+        for (auto n : ctx.nfsd_threads_sweep) {
+            if (n < 1) {
+                // Writing 0 would stop nfsd.
+                EFMT("nfsd thread counts must be at least 1");
+            }
+        }
+    }
+    if (vm.count("export-sweep")) {
+        ctx.export_sweep =
+            parse_int_list(vm["export-sweep"].as<std::string>());
+    }
+    if (ctx.export_variant != "per-dir" &&
+        ctx.export_variant != "per-client" &&
+        ctx.export_variant != "wildcard") {
+        EFMT("Unknown export variant '{}'", ctx.export_variant);
+    }
+    if (ctx.background_type != "tmpfs" && ctx.background_type != "bind") {
+        EFMT("Unknown background mount type '{}'", ctx.background_type);
+    }
     ctx.preserve_temp = vm["preserve"].as<bool>();
+    ctx.private_ns = vm["private-ns"].as<bool>();
+    ctx.propagation_sweep = vm["propagation-sweep"].as<bool>();
+    ctx.rpc_stats = vm["rpc-stats"].as<bool>();
+    ctx.rpc_trace = vm["rpc-trace"].as<bool>();
+    ctx.kmem = vm["kmem"].as<bool>();
+    ctx.mountstats = vm["mountstats"].as<bool>();
+    ctx.perf = vm["perf"].as<bool>();
+    ctx.pipeline = vm["pipeline"].as<bool>();
     ctx.verbose = vm["verbose"].as<bool>();
+    if (ctx.fixture != "none") {
+        if (ctx.pipeline) {
+            EFMT("--pipeline needs --fixture none");
+        }
+        if (ctx.private_ns && ctx.fixture != "reuse") {
+            // The fixture's bind mounts would only exist in our namespace.
+            EFMT("--fixture {} can't be used with --private-ns",
+                 ctx.fixture);
+        }
+    }
+    if (ctx.pipeline) {
+        if (!ctx.export_sweep.empty() || !ctx.background_mounts.empty() ||
+            !ctx.nfsd_threads_sweep.empty() || ctx.propagation_sweep) {
+            EFMT("--pipeline only applies to the single mount wave");
+        }
+        if (ctx.export_mode == "per-dir" &&
+            ctx.export_update != "incremental") {
+            // Rewriting the whole table for every directory would make
+            // the export stage quadratic.
+            EFMT("--pipeline with --export-mode per-dir needs "
+                 "--export-update incremental");
+        }
+        if (ctx.pipeline_depth < 1) {
+            EFMT("--pipeline-depth must be at least 1");
+        }
+    }
+
+    if (ctx.rpc_trace && tracefs_instances().empty()) {
+        EFMT("--rpc-trace needs tracefs mounted on /sys/kernel/tracing");
+    }
+
+    if (ctx.private_ns) {
+        enter_private_namespace(ctx);
+    }
+    if (!ctx.trace.empty()) {
+        tracer = std::make_unique<Tracer>(ctx.trace);
+    }
+    // Before any threads start, so that they inherit the counters.
+    if (ctx.perf) {
+        perf_counters = std::make_unique<PerfCounters>();
+    }
+    // After unsharing, which needs us to be single-threaded.
+    if (ctx.verbose) {
+        verbose_log.Start();
+    }
+    auto sampler = PressureSampler(ctx.sample_interval);
 
-    // Self-deleting temporary directory.
-    auto tdobj = TemporaryDirectory("paramount");
-    if (ctx.preserve_temp) {
+    // Self-deleting temporary directory, or the persistent fixture.
+    auto tdobj = ctx.fixture == "none"
+                     ? TemporaryDirectory("paramount")
+                     : TemporaryDirectory(TemporaryDirectory::FixedPath{},
+                                          ctx.fixture_dir);
+    if (ctx.preserve_temp || ctx.fixture == "create" ||
+        ctx.fixture == "reuse") {
         tdobj.PreserveContents();
     }
+    tdobj.SetDeleteThreads(ctx.setup_threads);
     auto tmpdir = tdobj.Dir();
 
     auto exports = fs::path("/etc/exports.d/paramount.exports");
+    auto paramount_exports = std::vector<ExportEntry>{};
+    // Pipelined export workers append to paramount_exports while an
+    // interrupted cleanup may be reading it.
+    auto exports_mutex = std::mutex{};
+
+    // Record the fixture's shape first, so that even a partly built
+    // fixture can be destroyed.
+    if (ctx.fixture == "create") {
+        write_fixture_manifest(ctx, manifest);
+    }
+
+    // Creating or destroying a fixture runs no mount workload.
+    auto cgroup = std::optional<WorkerCgroup>{};
+    if (!ctx.cgroup.empty() && ctx.fixture != "create" &&
+        ctx.fixture != "destroy") {
+        cgroup.emplace(ctx);
+    }
+
+    // The nfsd thread sweep changes a host-wide setting, so cleanup puts
+    // it back.
+    auto nfsd_threads = std::string{};
+    if (!ctx.nfsd_threads_sweep.empty()) {
+        nfsd_threads = boost::trim_copy(read_file(nfsd_threads_file));
+        if (nfsd_threads.empty()) {
+            EFMT("Can't read {}, is nfsd running?", nfsd_threads_file);
+        }
+        VERBOSE(ctx, "nfsd has {} threads", nfsd_threads);
+    }
 
     cleanup = [&]() {
         VERBOSE(ctx, "cleanup");
-        sleep(1);
-        VERBOSE(ctx, "unmount all NFS mounts");
-        bp::system("umount -a -t nfs");
-        bp::system("umount -a -t nfs4");
-        VERBOSE(ctx, "remove export file");
-        fs::remove(exports);
-        exportfs(ctx);
-        VERBOSE(ctx, "remove bind mounts");
-        bp::system(
-            "bash -c \"mount |grep tmpfs | grep paramount | awk '{print $3}' "
-            "| xargs "
-            "-rn 1 umount\"");
-        VERBOSE(ctx, "remove temp dir");
-        tdobj.DeleteNow();
+        // Helpers run in their own process groups, so a ^C doesn't reach
+        // them. Kill any still in flight, so that no mount lands after its
+        // tree has been detached.
+        for (const auto& child : ChildRegistry::Get().Snapshot()) {
+            VERBOSE(ctx, "kill {} '{}'", child.pid, child.label);
+            kill(-child.pid, SIGKILL);
+        }
+        if (ctx.rpc_trace) {
+            RpcTracepoints::RemoveAll();
+        }
+        if (!nfsd_threads.empty()) {
+            VERBOSE(ctx, "restore {} nfsd threads", nfsd_threads);
+            if (auto err = write_control(nfsd_threads_file, nfsd_threads)) {
+                std::cerr << fmt::format(
+                    FMT_STRING("Failed to restore nfsd threads: {}\n"),
+                    strerror(err));
+            }
+        }
+        if (cgroup) {
+            cgroup->Leave();
+            cgroup->Report();
+            cgroup->Remove();
+        }
+        if (ctx.fixture == "create") {
+            VERBOSE(ctx, "leave fixture {} in place", tmpdir.native());
+            return;
+        }
+        if (ctx.private_ns) {
+            // The namespace started as a copy of the host's mount table,
+            // so only detach the mounts we made, which all live under
+            // tmpdir, so the directory can be removed.
+            VERBOSE(ctx, "detach private mounts");
+            detach_mounts_under(ctx, tmpdir);
+        } else {
+            // The client NFS mounts, and any background ones. The bind
+            // mounts stay exported until the teardown below.
+            sleep(1);
+            VERBOSE(ctx, "unmount client and background mounts");
+            detach_mounts_under(ctx, tmpdir, tmpdir / "export");
+        }
+        auto our_exports = std::vector<ExportEntry>{};
+        {
+            std::lock_guard<std::mutex> lock(exports_mutex);
+            our_exports = paramount_exports;
+        }
+        if (ctx.fixture == "reuse") {
+            // Keep the fixture's own exports, but drop any filler exports
+            // an export table sweep added.
+            if (!ctx.export_sweep.empty()) {
+                VERBOSE(ctx, "restore fixture exports");
+                if (ctx.export_update == "incremental") {
+                    if (fs::remove(exports)) {
+                        exportfs(ctx);
+                    }
+                    for (const auto& entry : our_exports) {
+                        exportfs_add(ctx, entry);
+                    }
+                } else {
+                    write_exports(exports, our_exports);
+                    exportfs(ctx);
+                }
+            }
+        } else {
+            auto estart = launch_clock::now();
+            if (ctx.export_update == "incremental") {
+                VERBOSE(ctx, "remove exports");
+                for (const auto& entry : our_exports) {
+                    exportfs_remove(ctx, entry);
+                }
+            }
+            // The export table sweep writes the file even in incremental
+            // mode.
+            VERBOSE(ctx, "remove export file");
+            if (fs::remove(exports)) {
+                exportfs(ctx);
+            }
+            std::cout << fmt::format(
+                FMT_STRING("export teardown ({}) (ms): {:.2f}\n"),
+                ctx.export_update, to_ms(launch_clock::now() - estart));
+        }
+        // A reused fixture keeps its bind mounts for the next run.
+        if (!ctx.private_ns && ctx.fixture != "reuse") {
+            VERBOSE(ctx, "remove bind mounts");
+            detach_mounts_under(ctx, tmpdir / "export");
+        }
+        if (ctx.fixture != "reuse") {
+            VERBOSE(ctx, "remove temp dir");
+            auto phase = Phase(ctx, "rmtemp");
+            tdobj.DeleteNow();
+        }
     };
 
+    // Kernel memory before any setup, to judge cleanup against, and just
+    // before the single mount wave, to cost the mounts.
+    auto kmem_baseline = std::optional<KernelMemory>{};
+    auto kmem_before = std::optional<KernelMemory>{};
+    if (ctx.kmem) {
+        kmem_baseline = read_kernel_memory();
+    }
+
     struct sigaction crashaction {};
     crashaction.sa_sigaction = sig_handler;
     crashaction.sa_flags |= SA_SIGINFO;
@@ -143,196 +3330,251 @@ int main(int argc, char* argv[]) {
         // Map from mount to client mountpoint.
         std::unordered_map<std::string, std::string> m_to_c{};
 
-        // Create a list of directory stem names, 'd1234' etc.
-        auto dirname = std::vector<std::string>{};
-        for (int d = 0; d < ctx.threads; d++) {
-            dirname.push_back(fmt::format(FMT_STRING("d{:04}"), d));
-        }
+        // Create a list of directory names, 'd1234' or 's01/d001234' etc.
+        auto shards = std::vector<fs::path>{};
+        auto dirname = layout_dirnames(ctx, &shards);
 
-        // Create mount directories.
+        // Create the mount, export and client trees, relative to the
+        // temporary directory's descriptor and spread across the setup
+        // workers.
         auto mountdir = tmpdir / "mount";
-        if (!fs::create_directory(mountdir, ec)) {
-            EFMT_SYS(ec.value(), "Failed to create mount root directory {}",
-                     mountdir.native());
+        auto exdir = tmpdir / "export";
+        auto clientdir = tmpdir / "client";
+        // A reused or destroyed fixture has already been built.
+        auto build = ctx.fixture == "none" || ctx.fixture == "create";
+        if (build) {
+            for (const auto& root : {"mount", "export", "client"}) {
+                if (!tdobj.MkdirAt(root, ec)) {
+                    EFMT_SYS(ec.value(),
+                             "Failed to create {} root directory {}", root,
+                             (tmpdir / root).native());
+                }
+                for (const auto& shard : shards) {
+                    auto rel = fs::path(root) / shard;
+                    if (!tdobj.MkdirAt(rel, ec)) {
+                        EFMT_SYS(ec.value(), "Failed to create shard {}",
+                                 (tmpdir / rel).native());
+                    }
+                }
+            }
         }
 
         auto mdir = std::vector<fs::path>{};
+        auto cdir = std::vector<fs::path>{};
         for (int d = 0; d < ctx.threads; d++) {
-            auto newdir = mountdir / dirname[d];
-            if (!fs::create_directory(newdir, ec)) {
-                EFMT_SYS(ec.value(), "Failed to create mount directory {}",
-                         newdir.native());
-            }
-            VERBOSE(ctx, "Created mount {}", newdir.native());
-            mdir.push_back(newdir);
-        }
-
-        auto mountp = bp::search_path("mount");
-
-        auto exdir = tmpdir / "export";
-        if (!fs::create_directory(exdir, ec)) {
-            EFMT_SYS(ec.value(), "Failed to create export root directory {}",
-                     exdir.native());
+            mdir.push_back(mountdir / dirname[d]);
+            cdir.push_back(clientdir / dirname[d]);
         }
 
-        // Create bind mounts.
-        for (int d = 0; d < ctx.threads; d++) {
+        // The per-directory setup steps, run either as sequential phases
+        // spread across the setup workers, or pipelined. They run on worker
+        // threads, so they record errors in setup_error rather than exiting.
+        auto setup_error = FirstError{};
+        auto make_dirs = [&](int d) {
+            std::error_code ec;
+            for (const auto& root : {"mount", "export", "client"}) {
+                auto rel = fs::path(root) / dirname[d];
+                if (setup_error.Failed()) {
+                    return;
+                }
+                if (!tdobj.MkdirAt(rel, ec)) {
+                    setup_error.SetSys(
+                        ec.value(),
+                        fmt::format(FMT_STRING("Failed to create directory {}"),
+                                    (tmpdir / rel).native()));
+                }
+            }
+        };
+        // Bind mounts are made directly with mount(2).
+        auto bind_dir = [&](int d) {
             auto newdir = exdir / dirname[d];
-            if (!fs::create_directory(newdir, ec)) {
-                EFMT_SYS(ec.value(),
-                         "Failed to create export subdirectory {}",
-                         newdir.native());
-            }
-            bp::system(
-                fmt::format(FMT_STRING("{} -o bind {} {}"), mountp.native(),
-                            mdir[d].native(), newdir.native()),
-                ec);
-            if (ec.value() != 0) {
-                EFMT_SYS(ec.value(), "Failed to bind mount {} to {}",
-                         mdir[d].native(), newdir.native());
-            }
-        }
-
-        // Export mount directories.
-
-        auto ef = std::ofstream{};
-        ef.exceptions(std::ofstream::failbit);
-        ef.open(exports, std::ios_base::trunc);
-        ef << "### BEGIN paramount\n";
-
-        // auto muuid = std::vector<std::string>{};
-
-        // for (int d = 0; d < ctx.threads; d++) {
-        //     auto us = fmt::format(
-        //         FMT_STRING("00000000-0000-0000-0000-00000000{:04x}"), d);
-        //     muuid.push_back(us);
-        //     auto opts =
-        //         fmt::format("rw,no_subtree_check,no_root_squash,fsid={}",
-        //         us);
-        //     VERBOSE(ctx, "options: {}", opts);
-        //     // ef << mdir[d] << "\t*(" << opts << ")\n";
-        // }
-
-        // Export the root directory for the NFS pseudo filesystem.
-        ef << exdir.native()
-           << " *(rw,no_subtree_check,no_root_squash,fsid=root)\n";
-        ef << "### END paramount\n";
-        ef.close();
-
-        // Configure mounts.
-        exportfs(ctx);
+            if (setup_error.Failed()) {
+                return;
+            }
+            if (mount(mdir[d].c_str(), newdir.c_str(), nullptr, MS_BIND,
+                      nullptr) < 0) {
+                setup_error.SetSys(
+                    errno,
+                    fmt::format(FMT_STRING("Failed to bind mount {} to {}"),
+                                mdir[d].native(), newdir.native()));
+            }
+        };
+        // In per-directory mode there's one export per bind mount, each
+        // with a fixed fsid so that filehandles are stable from run to run.
+        // The all-zero UUID is avoided as it reads as 'unset'.
+        auto dir_export = [&](int d) {
+            auto us = fmt::format(
+                FMT_STRING("00000000-0000-0000-0000-{:012x}"), d + 1);
+            auto opts = fmt::format(
+                "rw,no_subtree_check,no_root_squash,fsid={}", us);
+            VERBOSE(ctx, "options: {}", opts);
+            return ExportEntry{(exdir / dirname[d]).native(), "*", opts};
+        };
+        auto configure_exports = [&]() {
+            auto span = TraceSpan("export", "phase");
+            auto rpc = rpc_snapshot(ctx);
+            auto perf = perf_snapshot();
+            auto estart = launch_clock::now();
+            if (ctx.export_update == "incremental") {
+                for (const auto& entry : paramount_exports) {
+                    exportfs_add(ctx, entry);
+                }
+            } else {
+                write_exports(exports, paramount_exports);
+                exportfs(ctx);
+            }
+            std::cout << fmt::format(
+                FMT_STRING("export setup ({}, {} entries) (ms): {:.2f}\n"),
+                ctx.export_update, paramount_exports.size(),
+                to_ms(launch_clock::now() - estart));
+            report_rpc_delta("export", rpc);
+            report_perf_delta("export", perf);
+        };
+        // The root directory for the NFS pseudo filesystem.
+        auto root_export = ExportEntry{
+            exdir.native(), "*",
+            "rw,no_subtree_check,no_root_squash,fsid=root"};
 
-        // Create client directories.
-        auto clientdir = tmpdir / "client";
-        if (!fs::create_directory(clientdir, ec)) {
-            EFMT_SYS(ec.value(), "Failed to create client root directory {}",
-                     clientdir.native());
-        }
+        auto mountp = bp::search_path("mount");
+        auto umountp = bp::search_path("umount");
 
-        auto cdir = std::vector<fs::path>{};
+        // The server path for each mount. Per-directory exports are
+        // mounted by their full path; the NFSv4 pseudo filesystem is
+        // generated above them.
+        auto remote = std::vector<std::string>{};
         for (int d = 0; d < ctx.threads; d++) {
-            auto newdir = clientdir / fmt::format(FMT_STRING("d{:04}"), d);
-            if (!fs::create_directory(newdir, ec)) {
-                EFMT_SYS(ec.value(), "Failed to create client directory {}",
-                         newdir.native());
+            if (ctx.export_mode == "per-dir") {
+                remote.push_back("127.0.0.1:" +
+                                 (exdir / dirname[d]).native());
+            } else {
+                remote.push_back("127.0.0.1:/" + dirname[d].native());
             }
-            VERBOSE(ctx, "Created client mountpoint {}", newdir.native());
-            cdir.push_back(newdir);
         }
 
         // Map together.
         for (int d = 0; d < ctx.threads; d++) {
-            m_to_c["127.0.0.1:/" + dirname[d]] = cdir[d];
+            m_to_c[remote[d]] = cdir[d];
         }
 
         // Mount each.
-        using mountfut = std::future<int>;
-        auto mounters = std::vector<mountfut>{};
-
-        auto start_barrier = boost::barrier(ctx.threads + 1);
-
+        auto wl = Workload{clientdir, tmpdir / "churn"};
+        wl.m_to_c = m_to_c;
         for (int d = 0; d < ctx.threads; d++) {
-            VERBOSE(ctx, "Start mounter {}", d);
-            mounters.emplace_back(std::async(
-                std::launch::async, [cd = cdir[d], ctx, d, dir = dirname[d],
-                                     md = mdir[d], mountp, &start_barrier]() {
-                    start_barrier.wait();
-                    VERBOSE(ctx, "mounter {} mdir {} mount on cdir {}", d,
-                            md.native(), cd.native());
-                    auto cmdline = fmt::format(
-                        FMT_STRING(
-                            "{} -t nfs -o rw,nfsvers=4.2 127.0.0.1:{} {}"),
-                        mountp.native(), "/" + dir, cd.native());
-                    VERBOSE(ctx, "mounter {} cmd '{}'", d, cmdline);
-                    std::error_code ec;
-                    bp::system(cmdline, ec);
-                    if (ec.value() != 0) {
-                        return ec.value();
-                    }
-                    return 0;  // XXX
-                }));
+            wl.mount_argvs.push_back(
+                {mountp.native(), "-t", "nfs", "-o", "rw,nfsvers=4.2",
+                 remote[d], cdir[d].native()});
+            wl.umount_argvs.push_back({umountp.native(), cdir[d].native()});
         }
 
-        start_barrier.wait();
+        // Sample kernel memory before the mount wave, if it's being
+        // reported.
+        auto kmem_sample = [&]() {
+            if (ctx.kmem) {
+                kmem_before = read_kernel_memory();
+            }
+        };
+        auto check_mounts = [&](const WaveResult& wave,
+                                launch_clock::time_point setup_start) {
+            std::cout << fmt::format(
+                FMT_STRING("setup to all mounted (ms): {:.2f}\n"),
+                to_ms(wave.end - setup_start));
+            auto nmounts =
+                verify_mounts(ctx, m_to_c, ctx.threads - wave.failures);
+            if (nmounts != static_cast<size_t>(ctx.threads)) {
+                std::cerr << fmt::format(
+                    FMT_STRING("NOTE: expected {} mounts, got {}\n"),
+                    ctx.threads, nmounts);
+            } else {
+                VERBOSE(ctx, "Mounts check out");
+            }
+            if (ctx.mountstats) {
+                report_mountstats("", clientdir);
+            }
+            if (kmem_before) {
+                report_kernel_memory("mount", *kmem_before,
+                                     read_kernel_memory(), nmounts);
+            }
+        };
 
-        int failures = 0;
-        for (auto& future : mounters) {
-            if (future.get() != 0) {
-                failures++;
-            }
-        }
-        if (failures) {
-            std::cerr << "Got " << failures << " mount failures\n";
-        }
-
-        size_t nmounts = 0;
-        do {
-            // Scan /proc/mounts.
-            VERBOSE(ctx, "Scan mounts");
-            auto mstr = std::ifstream{};
-            auto old_e = mstr.exceptions();
-            mstr.exceptions(std::iostream::failbit);
-            mstr.open("/proc/self/mounts");
-            mstr.exceptions(old_e);
-
-            auto mline = std::vector<std::string>{};
-            for (std::string line; std::getline(mstr, line);)
-                mline.push_back(line);
-            mstr.close();
-
-            nmounts = 0;
-            for (const auto& mount : mline) {
-                auto fields = std::vector<std::string>{};
-                // fields:
-                // 0      1          2          3       4        5
-                // device mountpoint filesystem options dontcare dontcare
-                boost::split(fields, mount, boost::is_any_of(" "),
-                             boost::token_compress_on);
-                if (fields[2] != "nfs" && fields[2] != "nfs4") {
-                    continue;
+        auto setup_start = launch_clock::now();
+        if (ctx.pipeline) {
+            auto stages = std::vector<PipelineStage>{{"mkdir", make_dirs},
+                                                     {"bind", bind_dir}};
+            if (ctx.export_mode == "per-dir") {
+                stages.push_back({"export", [&](int d) {
+                                      auto entry = dir_export(d);
+                                      if (!exportfs_add(ctx, entry,
+                                                        &setup_error)) {
+                                          return;
+                                      }
+                                      std::lock_guard<std::mutex> lock(
+                                          exports_mutex);
+                                      paramount_exports.push_back(entry);
+                                  }});
+            } else {
+                // Every mount goes through the pseudo-root, so it has to
+                // be exported before the first one.
+                paramount_exports.push_back(root_export);
+                configure_exports();
+            }
+            // This includes the fixture's own directories and bind mounts.
+            kmem_sample();
+            if (cgroup) {
+                // Setup is part of the pipeline, so it's limited too.
+                cgroup->Enter();
+            }
+            auto wave = pipelined_wave(ctx, wl, stages, setup_error);
+            check_mounts(wave, setup_start);
+        } else {
+            if (build) {
+                {
+                    auto phase = Phase(ctx, "mkdir");
+                    parallel_for(ctx.threads, ctx.setup_threads, make_dirs);
                 }
-                nmounts++;
-
-                // Check mount-to-client-mountpoint.
-                auto m = fields[0];
-                auto c = fields[1];
-                auto srch = m_to_c.find(m);
-                if (srch == m_to_c.end()) {
-                    EFMT("Mount '{}' not found in map", m);
+                setup_error.Check();
+                {
+                    auto phase = Phase(ctx, "bind");
+                    parallel_for(ctx.threads, ctx.setup_threads, bind_dir);
                 }
-                if (srch->second != c) {
-                    EFMT("Mount '{}' expected mountpoint {} found {}", m, c,
-                         srch->second);
+                setup_error.Check();
+            }
+
+            // Export mount directories.
+            if (ctx.export_mode == "per-dir") {
+                for (int d = 0; d < ctx.threads; d++) {
+                    paramount_exports.push_back(dir_export(d));
                 }
+            } else {
+                paramount_exports.push_back(root_export);
+            }
+            if (build) {
+                configure_exports();
+            }
+            if (cgroup) {
+                cgroup->Enter();
             }
-        } while (cleanup && nmounts < ctx.threads);
 
-        if (nmounts != ctx.threads) {
-            std::cerr << fmt::format(
-                FMT_STRING("NOTE: expected {} mounts, got {}\n"), ctx.threads,
-                nmounts);
-        } else {
-            VERBOSE(ctx, "Mounts check out");
+            if (ctx.fixture == "create") {
+                std::cout << fmt::format(
+                    FMT_STRING("fixture {} created (ms): {:.2f}\n"),
+                    tmpdir.native(),
+                    to_ms(launch_clock::now() - setup_start));
+            } else if (ctx.fixture == "destroy") {
+                VERBOSE(ctx, "destroy fixture {}", tmpdir.native());
+            } else if (!ctx.export_sweep.empty()) {
+                export_table_experiment(ctx, wl, exports, paramount_exports,
+                                        tmpdir / "filler");
+            } else if (!ctx.background_mounts.empty()) {
+                background_experiment(ctx, wl, tmpdir / "background");
+            } else if (!ctx.nfsd_threads_sweep.empty()) {
+                nfsd_threads_experiment(ctx, wl);
+            } else if (ctx.propagation_sweep) {
+                propagation_experiment(ctx, wl);
+            } else {
+                kmem_sample();
+                auto wave = mount_wave(ctx, wl, "");
+                check_mounts(wave, setup_start);
+            }
         }
 
     } catch (std::exception& e) {
@@ -340,8 +3582,15 @@ int main(int argc, char* argv[]) {
         exit_code = EXIT_FAILURE;
     }
 
-    if (cleanup) {
-        (*cleanup)();
+    run_cleanup();
+    if (kmem_baseline) {
+        // Slab objects are partly freed after an RCU grace period, so some
+        // of this may yet be reclaimed.
+        report_kernel_memory("unreclaimed after cleanup", *kmem_baseline,
+                             read_kernel_memory(), 0);
+    }
+    if (tracer) {
+        tracer->Write();
     }
 
     return exit_code;
@@ -11,11 +11,23 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <filesystem>
+#include <mutex>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
 
 namespace fs = std::filesystem;
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include "limits.h"
 
 /****************************************************************************/
@@ -49,6 +61,16 @@ namespace fs = std::filesystem;
  * tmp->Dir(), and will be deleted at the end of the case. Naturally, `tmp`
  * can be in a standalone (non-fixture) test as a temporary variable too. As
  * long as its destructor gets called automatically, it's fine.
+ *
+ * For building large trees, DirFd() returns an O_PATH descriptor for the
+ * directory, and MkdirAt() / UnlinkAt() work relative to it, which saves
+ * the kernel resolving the full path each time. If SetDeleteThreads() is
+ * given more than one thread, deletion uses a parallel getdents64(2)-based
+ * walker instead of std::filesystem::remove_all(). The walker doesn't cross
+ * into other filesystems, so anything still mounted inside the directory is
+ * left alone (as is, necessarily, the mount point itself). Bind mounts from
+ * the same filesystem share its st_dev and can't be told apart this way, so
+ * unmount those first.
  */
 class TemporaryDirectory {
    public:
@@ -64,18 +86,88 @@ class TemporaryDirectory {
      * template passed to mkdtemp(3).
      */
     TemporaryDirectory(std::string prefix) { Create(prefix); }
-    ~TemporaryDirectory() { DeleteNow(); }
+    //! Tag selecting a fixed directory rather than a mkdtemp(3) one.
+    struct FixedPath {};
+    /**
+     * @brief Use the directory @p dir, creating it (and its parents) if it
+     * doesn't already exist. Deletion works as for a generated directory,
+     * so call PreserveContents() if it should outlive the object.
+     */
+    TemporaryDirectory(FixedPath, const fs::path &dir) {
+        fs::create_directories(dir);
+        dir_ = dir;
+    }
+    ~TemporaryDirectory() {
+        DeleteNow();
+        if (dirfd_ >= 0) {
+            close(dirfd_);
+        }
+    }
 
     //! Return the temporary directory path.
     fs::path Dir() { return dir_; }
 
+    //! Return an O_PATH descriptor for the directory, for use with *at()
+    //! calls. It remains owned by this object.
+    int DirFd() {
+        if (dirfd_ < 0) {
+            dirfd_ = open(dir_.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+            if (dirfd_ < 0) {
+                throw std::system_error(errno, std::generic_category(),
+                                        "open " + dir_.native());
+            }
+        }
+        return dirfd_;
+    }
+
+    /**
+     * @brief Create directory @p rel, relative to the temporary directory.
+     *
+     * @return true on success, otherwise false with @p ec set.
+     */
+    bool MkdirAt(const fs::path &rel, std::error_code &ec,
+                 mode_t mode = 0755) {
+        if (mkdirat(DirFd(), rel.c_str(), mode) < 0) {
+            ec = std::error_code(errno, std::generic_category());
+            return false;
+        }
+        ec.clear();
+        return true;
+    }
+
+    /**
+     * @brief Remove file @p rel, or empty directory @p rel if @p dir is set,
+     * relative to the temporary directory.
+     *
+     * @return true on success, otherwise false with @p ec set.
+     */
+    bool UnlinkAt(const fs::path &rel, std::error_code &ec,
+                  bool dir = false) {
+        if (unlinkat(DirFd(), rel.c_str(), dir ? AT_REMOVEDIR : 0) < 0) {
+            ec = std::error_code(errno, std::generic_category());
+            return false;
+        }
+        ec.clear();
+        return true;
+    }
+
+    //! Use @p threads threads to delete the directory. 1 (the default) uses
+    //! std::filesystem::remove_all().
+    void SetDeleteThreads(int threads) { delete_threads_ = threads; }
+
     void DeleteNow() {
         // Allow the user to prevent deletion.
         // bool skipdelete;
         // if (env_get_bool("PRESERVE_TMP", &skipdelete) && skipdelete)
         //     return;
-        if (!preserve_ && dir_ != "")
+        if (preserve_ || dir_ == "" || done_)
+            return;
+        if (delete_threads_ > 1) {
+            ParallelRemove();
+        } else {
             fs::remove_all(dir_);
+        }
+        done_ = true;
     }
     //! Prevent deletion of the directory at object destruction time.
     void PreserveContents() { preserve_ = true; }
@@ -96,6 +188,150 @@ class TemporaryDirectory {
         dir_ = fs::path{tmp};
     }
 
+    // A directory being deleted. `pending` counts the unfinished children,
+    // plus one for the scan of the directory itself. When it reaches zero
+    // the directory is empty and can be removed from its parent.
+    struct Node {
+        Node *parent;
+        std::string name;
+        int fd = -1;
+        std::atomic<int> pending{1};
+    };
+
+    void ParallelRemove() {
+        int rootfd = open(dir_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (rootfd < 0) {
+            return;  // Already gone.
+        }
+        struct stat st;
+        fstat(rootfd, &st);
+        root_dev_ = st.st_dev;
+
+        auto root = new Node{nullptr, "", rootfd};
+        queue_.push_back(root);
+        auto pool = std::vector<std::thread>{};
+        for (int t = 0; t < delete_threads_; t++) {
+            pool.emplace_back([this]() { RemoveWorker(); });
+        }
+        for (auto &t : pool) {
+            t.join();
+        }
+        rmdir(dir_.c_str());
+    }
+
+    void RemoveWorker() {
+        for (;;) {
+            Node *node;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return !queue_.empty() || done_; });
+                if (queue_.empty()) {
+                    return;
+                }
+                node = queue_.front();
+                queue_.pop_front();
+            }
+            Scan(node);
+            Finish(node);
+        }
+    }
+
+    //! Unlink @p node's files, and queue its subdirectories.
+    void Scan(Node *node) {
+        if (node->parent) {
+            node->fd =
+                openat(node->parent->fd, node->name.c_str(),
+                       O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (node->fd < 0) {
+                return;
+            }
+        }
+        struct linux_dirent64 {
+            ino64_t d_ino;
+            off64_t d_off;
+            unsigned short d_reclen;
+            unsigned char d_type;
+            char d_name[];
+        };
+        // Read the whole directory before changing it.
+        auto entries = std::vector<std::pair<std::string, unsigned char>>{};
+        alignas(8) char buf[32768];
+        for (;;) {
+            auto n = syscall(SYS_getdents64, node->fd, buf, sizeof(buf));
+            if (n <= 0) {
+                break;
+            }
+            for (long off = 0; off < n;) {
+                auto d = reinterpret_cast<linux_dirent64 *>(buf + off);
+                off += d->d_reclen;
+                if (strcmp(d->d_name, ".") && strcmp(d->d_name, "..")) {
+                    entries.emplace_back(d->d_name, d->d_type);
+                }
+            }
+        }
+        auto children = std::vector<Node *>{};
+        for (const auto &[name, type] : entries) {
+            bool isdir = type == DT_DIR;
+            struct stat st;
+            if (type == DT_UNKNOWN &&
+                fstatat(node->fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) ==
+                    0) {
+                isdir = S_ISDIR(st.st_mode);
+            }
+            if (!isdir) {
+                unlinkat(node->fd, name.c_str(), 0);
+                continue;
+            }
+            // Don't descend into mount points.
+            if (fstatat(node->fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) <
+                    0 ||
+                st.st_dev != root_dev_) {
+                continue;
+            }
+            node->pending++;
+            children.push_back(new Node{node, name});
+        }
+        if (!children.empty()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                queue_.insert(queue_.end(), children.begin(), children.end());
+            }
+            cv_.notify_all();
+        }
+    }
+
+    //! Drop a reference to @p node, removing it (and perhaps its
+    //! ancestors) once it has no unfinished children.
+    void Finish(Node *node) {
+        while (node && --node->pending == 0) {
+            if (node->fd >= 0) {
+                close(node->fd);
+            }
+            auto parent = node->parent;
+            if (parent) {
+                unlinkat(parent->fd, node->name.c_str(), AT_REMOVEDIR);
+            } else {
+                // The root is done, so everything is.
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    done_ = true;
+                }
+                cv_.notify_all();
+            }
+            delete node;
+            node = parent;
+        }
+    }
+
     fs::path dir_;
     bool preserve_ = false;
+    int dirfd_ = -1;
+    int delete_threads_ = 1;
+
+    // Parallel removal state.
+    dev_t root_dev_ = 0;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Node *> queue_;
+    bool done_ = false;  // The tree is gone; also stops the removal workers.
 };  // class TemporaryDirectory